@@ -0,0 +1,246 @@
+// Standalone AudioHandler benchmark - no Nuke needed.
+// Runs on miniaudio's null backend, so it works on headless machines too.
+//
+//   audiohandler_bench [options] [file ...]
+//
+// With no files, a synthetic WAV is written to the temp directory and used.
+// Run one file per invocation for a meaningful peak RSS.
+
+#include "audioHandler.h"
+#include "benchCommon.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct Options
+{
+    double seconds = 600.0;
+    int channels = 2;
+    int sampleRate = 48000;
+    std::string format = "s16";
+    std::vector<int> widths = { 512, 1920, 4096 };
+    int scrubs = 2000;
+    float fps = 25.0f;
+    bool compress = false;
+    bool lazy = false;
+    int period = 0;
+    bool sequence = false;
+    std::vector<std::string> files;
+};
+
+static void usage()
+{
+    std::cout <<
+        "Usage: audiohandler_bench [options] [file ...]\n"
+        "  --seconds N      synthetic file length (default 600)\n"
+        "  --channels N     synthetic channel count (default 2)\n"
+        "  --rate N         synthetic sample rate (default 48000)\n"
+        "  --format F       synthetic sample format: s16, s24, f32 (default s16)\n"
+        "  --widths A,B,..  waveform widths to time (default 512,1920,4096)\n"
+        "  --scrubs N       playAtFrame calls to time (default 2000)\n"
+        "  --fps N          timeline fps (default 25)\n"
+        "  --compress       keep PCM block-compressed in memory\n"
+        "  --lazy           decode on demand\n"
+        "  --period N       audio callback size in frames, applied after load (default: built-in)\n"
+        "  --sequence       play a two-segment sequence list instead: a 44.1 kHz segment, then\n"
+        "                   one at --rate, so the timeline resamples the second\n";
+}
+
+static double peakRssMB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0.0;
+    return pmc.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / (1024.0 * 1024.0);    // bytes on macOS
+#else
+    return ru.ru_maxrss / 1024.0;               // KB on Linux
+#endif
+#endif
+}
+
+static void runFile(const std::string& path, const Options& opt)
+{
+    std::cout << "\n=== " << path << " ===" << std::endl;
+
+    AudioHandler handler(AudioHandler::DEVICE_NULL);
+    handler.setCompressPcm(opt.compress);
+    handler.setLazyDecode(opt.lazy);
+
+    auto start = Clock::now();
+    if (!handler.loadFile(path.c_str(), opt.fps)) {
+        std::cerr << "Failed to load " << path << std::endl;
+        return;
+    }
+    double loadMs = elapsedMs(start);
+
+    // Re-creates the device under the loaded file, the way the node's knob does
+    if (opt.period > 0 && !handler.setPeriodFrames((ma_uint32)opt.period)) {
+        std::cerr << "Failed to set period " << opt.period << std::endl;
+        return;
+    }
+    
+    int lengthInFrames = handler.getFileLengthInFrames();
+    std::cout << "load:             " << loadMs << " ms" << std::endl;
+    std::cout << "length:           " << lengthInFrames << " frames @ " << opt.fps << " fps, "
+              << handler.getChannels() << " ch" << std::endl;
+    std::cout << "peak RSS:         " << peakRssMB() << " MB" << std::endl;
+
+    for (int width : opt.widths) {
+        start = Clock::now();
+        handler.generateWaveform(width);
+        std::string label = "waveform " + std::to_string(width) + ":";
+        label.resize(18, ' ');
+        std::cout << label << elapsedMs(start) << " ms" << std::endl;
+    }
+
+    if (lengthInFrames <= 0 || opt.scrubs <= 0) return;
+
+    // Half sequential (playback-like), half random jumps (scrubbing)
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> anyFrame(0, lengthInFrames - 1);
+    std::vector<double> latencies;
+    latencies.reserve(opt.scrubs);
+
+    for (int i = 0; i < opt.scrubs; i++) {
+        int frame = (i < opt.scrubs / 2) ? (i % lengthInFrames) : anyFrame(rng);
+        start = Clock::now();
+        handler.playAtFrame(frame);
+        latencies.push_back(elapsedMs(start) * 1000.0);
+    }
+
+    std::cout << "playAtFrame us:   p50 " << percentile(latencies, 50)
+              << "  p90 " << percentile(latencies, 90)
+              << "  p99 " << percentile(latencies, 99)
+              << "  max " << percentile(latencies, 100) << std::endl;
+
+    AudioHandler::Stats stats = handler.getStats();
+    std::cout << "counters:         " << stats.playCalls << " calls, " << stats.skippedFrames << " skipped, "
+              << stats.coalescedFrames << " coalesced, " << stats.lockWaits << " lock waits ("
+              << stats.lockWaitMs << " ms), " << stats.underruns << " underruns" << std::endl;
+    std::cout << "resident:         PCM " << stats.pcmBytes / (1024.0 * 1024.0) << " MB, decoded "
+              << stats.decodedBytes / (1024.0 * 1024.0) << " MB, waveform " << stats.waveformBytes / 1024.0 << " KB" << std::endl;
+
+    AudioHandler::CallbackStats callbacks = handler.getCallbackStats();
+    std::cout << "callbacks:        " << callbacks.callbacks << " x " << callbacks.periodFrames << " frames, mixing mean "
+              << callbacks.meanMs << " ms / max " << callbacks.maxMs << " ms, jitter mean " << callbacks.jitterMeanMs
+              << " ms / max " << callbacks.jitterMaxMs << " ms" << std::endl;
+    for (int i = 0; i < AudioHandler::CALLBACK_HISTOGRAM_BUCKETS; i++) {
+        std::string edge = i < AudioHandler::CALLBACK_HISTOGRAM_BUCKETS - 1
+            ? "<= " + std::to_string(AudioHandler::CALLBACK_HISTOGRAM_EDGES_US[i]) + " us" : "more";
+        edge.resize(12, ' ');
+        std::cout << "  " << edge << "mixing " << callbacks.durationHistogram[i]
+                  << "\tjitter " << callbacks.jitterHistogram[i] << std::endl;
+    }
+    std::cout << "peak RSS:         " << peakRssMB() << " MB" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage();
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--seconds") opt.seconds = std::atof(next());
+        else if (arg == "--channels") opt.channels = std::max(1, std::atoi(next()));
+        else if (arg == "--rate") opt.sampleRate = std::max(8000, std::atoi(next()));
+        else if (arg == "--format") opt.format = next();
+        else if (arg == "--scrubs") opt.scrubs = std::atoi(next());
+        else if (arg == "--fps") opt.fps = (float)std::atof(next());
+        else if (arg == "--compress") opt.compress = true;
+        else if (arg == "--lazy") opt.lazy = true;
+        else if (arg == "--period") opt.period = std::atoi(next());
+        else if (arg == "--sequence") opt.sequence = true;
+        else if (arg == "--widths") {
+            opt.widths.clear();
+            std::stringstream list(next());
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                if (std::atoi(item.c_str()) > 0) opt.widths.push_back(std::atoi(item.c_str()));
+            }
+        }
+        else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            usage();
+            return 1;
+        }
+        else opt.files.push_back(arg);
+    }
+
+    if (opt.format != "s16" && opt.format != "s24" && opt.format != "f32") {
+        usage();
+        return 1;
+    }
+
+    std::vector<std::string> synthetic;
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+    if (ec) dir = ".";
+
+    if (opt.sequence) {
+        // The first segment sets the timeline rate - start with a non-48k file
+        std::string first = (dir / "audiohandler_bench_seq_44100.wav").string();
+        std::string second = (dir / ("audiohandler_bench_seq_" + std::to_string(opt.sampleRate) + ".wav")).string();
+        std::string list = (dir / "audiohandler_bench_seq.seq").string();
+        int half = std::max(1, (int)(opt.seconds * opt.fps / 2));
+
+        std::cout << "Writing synthetic sequence " << opt.seconds << "s, 44100 Hz then "
+                  << opt.sampleRate << " Hz: " << list << std::endl;
+        std::ofstream out(list);
+        out << first << " 0 " << half << "\n" << second << " " << half << " " << 2 * half << "\n";
+        out.close();
+        synthetic = { first, second, list };
+        if (!out || !writeSyntheticWav(first, opt.seconds / 2, opt.channels, 44100, opt.format) ||
+            !writeSyntheticWav(second, opt.seconds / 2, opt.channels, opt.sampleRate, opt.format)) {
+            std::cerr << "Failed to write " << list << std::endl;
+            return 1;
+        }
+        opt.files.push_back(list);
+    } else if (opt.files.empty()) {
+        std::string file = (dir / ("audiohandler_bench_" + std::to_string(opt.channels) + "ch_" + opt.format + ".wav")).string();
+
+        std::cout << "Writing synthetic " << opt.seconds << "s " << opt.channels << " ch "
+                  << opt.format << " @ " << opt.sampleRate << " Hz: " << file << std::endl;
+        if (!writeSyntheticWav(file, opt.seconds, opt.channels, opt.sampleRate, opt.format)) {
+            std::cerr << "Failed to write " << file << std::endl;
+            return 1;
+        }
+        synthetic.push_back(file);
+        opt.files.push_back(file);
+    }
+
+    for (const std::string& file : opt.files) {
+        runFile(file, opt);
+    }
+
+    for (const std::string& file : synthetic) {
+        std::filesystem::remove(file, ec);
+    }
+    return 0;
+}
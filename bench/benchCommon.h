@@ -0,0 +1,105 @@
+// Shared helpers for the standalone bench tools
+
+#ifndef BENCHCOMMON_H
+#define BENCHCOMMON_H
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+typedef std::chrono::steady_clock Clock;
+
+inline double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+inline double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t idx = (size_t)std::min<double>(values.size() - 1, p / 100.0 * (values.size() - 1) + 0.5);
+    return values[idx];
+}
+
+inline void put16(std::ofstream& out, uint16_t v) { out.write((const char*)&v, 2); }
+inline void put32(std::ofstream& out, uint32_t v) { out.write((const char*)&v, 4); }
+
+inline void writeWavHeader(std::ofstream& out, int formatTag, int channels, int sampleRate,
+                           int bytesPerSample, uint32_t dataBytes)
+{
+    out.write("RIFF", 4);
+    put32(out, 36 + dataBytes);
+    out.write("WAVEfmt ", 8);
+    put32(out, 16);
+    put16(out, (uint16_t)formatTag);
+    put16(out, (uint16_t)channels);
+    put32(out, (uint32_t)sampleRate);
+    put32(out, (uint32_t)(sampleRate * channels * bytesPerSample));
+    put16(out, (uint16_t)(channels * bytesPerSample));
+    put16(out, (uint16_t)(bytesPerSample * 8));
+    out.write("data", 4);
+    put32(out, dataBytes);
+}
+
+// Tones plus a little noise, so codecs and peak scans see realistic data.
+// format is s16, s24 or f32.
+inline bool writeSyntheticWav(const std::string& path, double seconds, int channels, int sampleRate,
+                              const std::string& format)
+{
+    int bytesPerSample = format == "s24" ? 3 : (format == "f32" ? 4 : 2);
+    uint64_t frames = (uint64_t)(seconds * sampleRate);
+    uint64_t dataBytes = frames * channels * bytesPerSample;
+    if (dataBytes > 0xFFFFFFF0ull) {
+        std::cerr << "Synthetic file too large for WAV" << std::endl;
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    writeWavHeader(out, format == "f32" ? 3 : 1, channels, sampleRate, bytesPerSample, (uint32_t)dataBytes);
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> noise(-0.02f, 0.02f);
+    const double twoPi = 6.283185307179586;
+
+    std::vector<char> chunk;
+    const uint64_t chunkFrames = 65536;
+
+    for (uint64_t start = 0; start < frames; start += chunkFrames) {
+        uint64_t n = std::min(chunkFrames, frames - start);
+        chunk.resize(n * channels * bytesPerSample);
+        char* p = chunk.data();
+
+        for (uint64_t i = 0; i < n; i++) {
+            double t = (double)(start + i) / sampleRate;
+            // Syllable-like envelope so features and peaks move
+            double env = 0.5 + 0.5 * std::sin(twoPi * 3.0 * t);
+
+            for (int c = 0; c < channels; c++) {
+                float v = (float)(0.5 * env * std::sin(twoPi * (110.0 * (c + 1)) * t)) + noise(rng);
+
+                if (format == "f32") {
+                    memcpy(p, &v, 4);
+                } else {
+                    int32_t s = (int32_t)std::lround(v * (bytesPerSample == 3 ? 8388607.0 : 32767.0));
+                    memcpy(p, &s, bytesPerSample);      // little-endian low bytes
+                }
+                p += bytesPerSample;
+            }
+        }
+        out.write(chunk.data(), chunk.size());
+    }
+
+    return (bool)out;
+}
+
+#endif
@@ -0,0 +1,373 @@
+// Scrub-trace replay - plays a recorded sequence of playAtFrame requests
+// against AudioHandler with no audio device, and measures what came out.
+//
+//   audiohandler_scrub_replay [options] [audio file]
+//
+// Trace files are text, one "<ms> <frame>" request per line, '#' comments.
+// Record one from Nuke with AUDIOPLAYER_SCRUB_LOG=<file>. Without --trace a
+// synthetic mix of drags, playback and jumps is generated.
+//
+// Time is virtual: the output is pulled one period at a time, as a device
+// callback would, and each request lands between callbacks at its timestamp.
+// Runs are repeatable, so two builds can be compared on the same trace.
+//
+//   first sample   request time -> start of the first callback that carries
+//                  the new grain (includes the playAtFrame call itself)
+//   dropped        grain replaced before any of it was heard
+//   cut short      grain replaced more than a callback short of a full video
+//                  frame (the stop time runs from the request, so a callback's
+//                  worth of wait is always lost)
+//   discontinuity  sample-to-sample step above --click on either channel
+
+#include "audioHandler.h"
+#include "benchCommon.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+
+// initEngine mixes at this rate
+static const int ENGINE_RATE = 48000;
+
+struct Options
+{
+    std::string trace;
+    double traceSeconds = 60.0;
+    int period = 128;
+    float fps = 25.0f;
+    float click = 0.3f;
+    std::string outWav;
+    bool compress = false;
+    bool lazy = false;
+    std::string file;
+};
+
+struct Request
+{
+    double ms;
+    int frame;
+};
+
+static void usage()
+{
+    std::cout <<
+        "Usage: audiohandler_scrub_replay [options] [audio file]\n"
+        "  --trace FILE     '<ms> <frame>' per line (default: synthetic)\n"
+        "  --seconds N      synthetic trace length (default 60)\n"
+        "  --period N       callback size in frames (default 128)\n"
+        "  --fps N          timeline fps (default 25)\n"
+        "  --click X        step counted as a discontinuity (default 0.3)\n"
+        "  --out FILE       write the rendered output as a float WAV\n"
+        "  --compress       keep PCM block-compressed in memory\n"
+        "  --lazy           decode on demand\n";
+}
+
+static bool readTrace(const std::string& path, std::vector<Request>& trace)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        for (auto& ch : line) if (ch == ',') ch = ' ';
+        std::istringstream fields(line);
+        Request r;
+        if (fields >> r.ms >> r.frame) {
+            // Timestamps must not run backwards
+            if (!trace.empty()) r.ms = std::max(r.ms, trace.back().ms);
+            trace.push_back(r);
+        }
+    }
+    return true;
+}
+
+// Drags at mouse-event rate, stretches of playback, and the odd jump
+static std::vector<Request> syntheticTrace(double seconds, float fps, int lengthInFrames)
+{
+    std::vector<Request> trace;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    double ms = 0.0;
+    int frame = lengthInFrames / 2;
+
+    while (ms < seconds * 1000.0) {
+        double mode = unit(rng);
+        int events = 10 + (int)(unit(rng) * 60);
+
+        if (mode < 0.6) {
+            // Drag: 8-40 ms between events, 0-3 frames per step, either direction
+            int dir = unit(rng) < 0.5 ? -1 : 1;
+            for (int i = 0; i < events; i++) {
+                ms += 8.0 + unit(rng) * 32.0;
+                frame += dir * (int)(unit(rng) * 4);
+                frame = std::max(0, std::min(lengthInFrames - 1, frame));
+                trace.push_back({ ms, frame });
+            }
+        } else if (mode < 0.9) {
+            // Playback: one request per frame, with a little timer jitter
+            for (int i = 0; i < events; i++) {
+                ms += 1000.0 / fps + (unit(rng) - 0.5) * 4.0;
+                frame = std::min(lengthInFrames - 1, frame + 1);
+                trace.push_back({ ms, frame });
+            }
+        } else {
+            ms += 100.0 + unit(rng) * 400.0;
+            frame = (int)(unit(rng) * (lengthInFrames - 1));
+            trace.push_back({ ms, frame });
+        }
+    }
+    return trace;
+}
+
+static bool writeFloatWav(const std::string& path, const std::vector<float>& samples)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    uint64_t dataBytes = std::min<uint64_t>(samples.size() * sizeof(float), 0xFFFFFFF0ull);
+    writeWavHeader(out, 3, 2, ENGINE_RATE, 4, (uint32_t)dataBytes);
+    out.write((const char*)samples.data(), dataBytes);
+    return (bool)out;
+}
+
+class Replay
+{
+public:
+    Replay(AudioHandler& handler, const Options& opt)
+        : _handler(handler)
+        , _opt(opt)
+        , _buffer(opt.period * 2)
+        , _periodMs(opt.period * 1000.0 / ENGINE_RATE)
+        , _grainFrames((double)handler.getSampleRate() / opt.fps)
+        , _periodFileFrames((double)opt.period * handler.getSampleRate() / ENGINE_RATE)
+    {
+    }
+
+    void run(const std::vector<Request>& trace)
+    {
+        int lengthInFrames = _handler.getFileLengthInFrames();
+        int lastFrame = -9999;
+
+        for (const Request& r : trace) {
+            // Callbacks due before the request see the old state
+            while (_callback * _periodMs < r.ms) render();
+
+            _requests++;
+            if (r.frame == lastFrame) {
+                _sameFrame++;
+                continue;
+            }
+            lastFrame = r.frame;
+
+            auto start = Clock::now();
+            _handler.playAtFrame(r.frame);
+            double wallMs = elapsedMs(start);
+            _callUs.push_back(wallMs * 1000.0);
+
+            closeGrain();
+            if (r.frame < 0 || r.frame >= lengthInFrames) {
+                _outOfRange++;
+                continue;
+            }
+
+            _grain = true;
+            _grainStart = _handler.getPlaybackCursor();
+            _grainRequestMs = r.ms;
+            _grainReadyMs = r.ms + wallMs;
+            _grainHeard = 0;
+        }
+
+        // Let the last grain finish
+        double endMs = _callback * _periodMs + 2000.0 / _opt.fps;
+        while (_callback * _periodMs < endMs) render();
+        closeGrain();
+    }
+
+    void report() const
+    {
+        std::cout << "requests:         " << _requests << "  (same frame " << _sameFrame
+                  << ", out of range " << _outOfRange << ")" << std::endl;
+        std::cout << "grains:           " << _firstSampleMs.size() << " heard, " << _dropped
+                  << " dropped, " << _cutShort << " cut short" << std::endl;
+        std::cout << "first sample ms:  p50 " << percentile(_firstSampleMs, 50)
+                  << "  p90 " << percentile(_firstSampleMs, 90)
+                  << "  p99 " << percentile(_firstSampleMs, 99)
+                  << "  max " << percentile(_firstSampleMs, 100) << std::endl;
+        std::cout << "playAtFrame us:   p50 " << percentile(_callUs, 50)
+                  << "  p99 " << percentile(_callUs, 99)
+                  << "  max " << percentile(_callUs, 100) << std::endl;
+        std::cout << "discontinuities:  " << _discontinuities << "  (step > " << _opt.click << ")" << std::endl;
+    }
+
+    const std::vector<float>& output() const { return _output; }
+
+private:
+    // One device callback's worth of output
+    void render()
+    {
+        double callbackMs = _callback * _periodMs;
+        _callback++;
+
+        std::fill(_buffer.begin(), _buffer.end(), 0.0f);
+        _handler.renderOutput(_buffer.data(), _opt.period);
+
+        for (int i = 0; i < _opt.period; i++) {
+            float l = _buffer[i * 2];
+            float r = _buffer[i * 2 + 1];
+
+            // One click per audible event, not one per sample of a jump
+            if (_clickHoldoff > 0) {
+                _clickHoldoff--;
+            } else if (std::fabs(l - _prevL) > _opt.click || std::fabs(r - _prevR) > _opt.click) {
+                _discontinuities++;
+                _clickHoldoff = 32;
+            }
+            _prevL = l;
+            _prevR = r;
+        }
+
+        if (!_opt.outWav.empty()) _output.insert(_output.end(), _buffer.begin(), _buffer.end());
+
+        if (!_grain || _grainStart < 0) return;
+
+        long long heard = _handler.getPlaybackCursor() - _grainStart;
+        if (heard > 0 && _grainHeard == 0) {
+            _firstSampleMs.push_back(std::max(callbackMs, _grainReadyMs) - _grainRequestMs);
+        }
+        _grainHeard = std::max(_grainHeard, heard);
+    }
+
+    void closeGrain()
+    {
+        if (!_grain) return;
+        _grain = false;
+
+        if (_grainHeard <= 0) _dropped++;
+        else if (_grainHeard + _periodFileFrames < _grainFrames) _cutShort++;
+    }
+
+    AudioHandler& _handler;
+    const Options& _opt;
+    std::vector<float> _buffer;
+    std::vector<float> _output;
+    double _periodMs;
+    double _grainFrames;
+    double _periodFileFrames;
+    long long _callback = 0;
+
+    bool _grain = false;
+    long long _grainStart = -1;
+    long long _grainHeard = 0;
+    double _grainRequestMs = 0.0;
+    double _grainReadyMs = 0.0;
+
+    int _requests = 0;
+    int _sameFrame = 0;
+    int _outOfRange = 0;
+    int _dropped = 0;
+    int _cutShort = 0;
+    int _discontinuities = 0;
+    int _clickHoldoff = 0;
+    float _prevL = 0.0f;
+    float _prevR = 0.0f;
+    std::vector<double> _firstSampleMs;
+    std::vector<double> _callUs;
+};
+
+int main(int argc, char** argv)
+{
+    Options opt;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage();
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--trace") opt.trace = next();
+        else if (arg == "--seconds") opt.traceSeconds = std::atof(next());
+        else if (arg == "--period") opt.period = std::max(16, std::atoi(next()));
+        else if (arg == "--fps") opt.fps = std::max(1.0f, (float)std::atof(next()));
+        else if (arg == "--click") opt.click = (float)std::atof(next());
+        else if (arg == "--out") opt.outWav = next();
+        else if (arg == "--compress") opt.compress = true;
+        else if (arg == "--lazy") opt.lazy = true;
+        else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            usage();
+            return 1;
+        }
+        else opt.file = arg;
+    }
+
+    std::string synthetic;
+    if (opt.file.empty()) {
+        std::error_code ec;
+        std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+        if (ec) dir = ".";
+        synthetic = (dir / "audiohandler_scrub_replay.wav").string();
+
+        if (!writeSyntheticWav(synthetic, 120.0, 2, ENGINE_RATE, "s16")) {
+            std::cerr << "Failed to write " << synthetic << std::endl;
+            return 1;
+        }
+        opt.file = synthetic;
+    }
+
+    AudioHandler handler(AudioHandler::DEVICE_NONE);
+    handler.setCompressPcm(opt.compress);
+    handler.setLazyDecode(opt.lazy);
+
+    bool loaded = handler.loadFile(opt.file.c_str(), opt.fps);
+    if (!synthetic.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(synthetic, ec);
+    }
+    if (!loaded || handler.getFileLengthInFrames() <= 0) {
+        std::cerr << "Failed to load " << opt.file << std::endl;
+        return 1;
+    }
+
+    std::vector<Request> trace;
+    if (!opt.trace.empty()) {
+        if (!readTrace(opt.trace, trace)) {
+            std::cerr << "Failed to read trace " << opt.trace << std::endl;
+            return 1;
+        }
+    } else {
+        trace = syntheticTrace(opt.traceSeconds, opt.fps, handler.getFileLengthInFrames());
+    }
+
+    std::cout << "\n=== " << (opt.trace.empty() ? std::string("synthetic trace") : opt.trace) << " -> "
+              << (synthetic.empty() ? opt.file : std::string("synthetic audio")) << " ===" << std::endl;
+    std::cout << "period:           " << opt.period << " frames (" << opt.period * 1000.0 / ENGINE_RATE
+              << " ms) @ " << opt.fps << " fps" << std::endl;
+
+    Replay replay(handler, opt);
+    replay.run(trace);
+    replay.report();
+
+    if (!opt.outWav.empty() && !writeFloatWav(opt.outWav, replay.output())) {
+        std::cerr << "Failed to write " << opt.outWav << std::endl;
+        return 1;
+    }
+    return 0;
+}
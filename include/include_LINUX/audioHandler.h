@@ -6,20 +6,65 @@
 #include <cstdint>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <condition_variable>
 
 typedef unsigned long long ma_uint64;
+typedef signed long long ma_int64;
 typedef unsigned int ma_uint32;
 
+typedef struct ma_context ma_context;
 typedef struct ma_engine ma_engine;
 typedef struct ma_sound ma_sound;
 typedef struct ma_decoder ma_decoder;
 
+struct PcmSource;
+struct MappedFile;
+struct EngineHost;
+struct MixTrack;
+struct SequenceSegment;
+struct FileWatch;
+
+// Chrome trace events: AUDIOPLAYER_TRACE=<file.json> records a begin/end pair per
+// scope into per-thread buffers, written out at exit or by traceFlush(). Open
+// the file in Perfetto or chrome://tracing. When off, a scope costs one branch.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name);  // name must outlive the trace - use a literal
+    ~TraceScope();
+    
+private:
+    const char* _name;
+    bool _active;           // the begin was recorded - so the end will be
+};
+
+bool traceEnabled();
+bool traceFlush();
+
 class AudioHandler
 {
 public:
-    AudioHandler();
+    // DEVICE_NULL runs on miniaudio's null backend - no audio hardware (benchmarks)
+    // DEVICE_NONE has no device thread at all - the caller pulls audio with renderOutput()
+    // DEVICE_OFF never creates an engine - load, waveform and features only (render farm)
+    enum DeviceMode { DEVICE_DEFAULT = 0, DEVICE_NULL, DEVICE_NONE, DEVICE_OFF };
+    
+    explicit AudioHandler(DeviceMode deviceMode = DEVICE_DEFAULT);
     ~AudioHandler();
+    
+    // Only before the engine is up (it starts lazily) - false if it's too late
+    bool setDeviceMode(DeviceMode deviceMode);
+    DeviceMode getDeviceMode() const { return _deviceMode; }
 
+    // A .txt or .seq file is read as a sequence list - one segment per line:
+    //   <file> <record in> <record out> [<source in>]
+    // in frames or HH:MM:SS:FF timecode. The segments play as one timeline starting at
+    // the earliest record in; only those near the playhead are open at any time.
+    // Loading the file that is already loaded, unchanged on disk (size, modification
+    // time, hash of sampled blocks) and with the same decode settings, keeps the
+    // decoded audio, waveform and sound - only the fps is applied.
     bool loadFile(const char* fileName, float fps);
     void releaseFile();
     
@@ -27,44 +72,406 @@ public:
     void playAtFrame(int frame);
     void stop();
     
+    // Remaps frames to samples without re-decoding. Features are binned per frame,
+    // so they are dropped until computeFeatures() runs again. The float form snaps
+    // NTSC rates (23.976, 29.97, 59.94 ...) to their exact x1000/1001 ratio.
     void setFps(float fps);
+    void setFps(ma_uint32 numerator, ma_uint32 denominator);
+    
+    // Fine sync on top of the caller's whole-frame offset (+ delays audio, - advances it).
+    // Baked into the frame table, so scrubbing costs nothing extra. Samples are at the
+    // file's native rate; milliseconds are converted whenever a file loads.
+    void setSubFrameOffsetSamples(ma_int64 samples);
+    void setSubFrameOffsetMs(double ms);
+    ma_int64 getSubFrameOffsetSamples() const;
+    
+    // How far the loaded file must be delayed to line up with a reference recording
+    // of the same take (camera scratch audio, say) - cross-correlates onset envelopes
+    // of both. confidence is 0..1; below ~0.1 the match is a guess.
+    bool estimateSyncOffset(const char* referenceFile, double& delaySeconds, float& confidence);
+    
+    // Broadcast WAV timecode - bext TimeReference, with the frame rate and drop-frame
+    // flag from iXML when present (fpsNum 0 if not). Read at load from the chunk
+    // headers only; readTimecode() does the same for any file without loading it.
+    struct Timecode
+    {
+        bool valid = false;
+        ma_uint64 samplesSinceMidnight = 0;     // at sampleRate
+        ma_uint32 sampleRate = 0;
+        ma_uint32 fpsNum = 0;
+        ma_uint32 fpsDen = 0;
+        bool dropFrame = false;
+    };
+    static bool readTimecode(const char* fileName, Timecode& timecode);
+    Timecode getTimecode();
+    
+    // How far audio with this timecode must be delayed to line up with the plate's
+    // first frame - plateTimecode is HH:MM:SS:FF (';' for drop-frame) at the current
+    // fps. Wraps at midnight, so it's never more than 12 hours either way.
+    bool timecodeDelay(const Timecode& timecode, const char* plateTimecode, double& delaySeconds);
+    
+    // DEVICE_NONE only: mix the next frameCount stereo f32 frames, as a device callback would
+    ma_uint64 renderOutput(float* out, ma_uint64 frameCount);
+    
+    // Read position of the current grain in file frames (seek target if not yet applied), -1 if none
+    long long getPlaybackCursor();
+    
+    // Channel selection - -1 plays all channels (downmixed), otherwise solo one
+    void setSoloChannel(int channel);
+    int getSoloChannel() const { return _soloChannel.load(); }
+    int getChannels() const { return (int)_channels; }
+    
+    // Lossless block compression of the PCM store - takes effect on next load
+    void setCompressPcm(bool enabled) { _compressPcm.store(enabled); }
+    bool getCompressPcm() const { return _compressPcm.load(); }
+    
+    // Decode blocks from the file as playback touches them instead of up front - next load
+    void setLazyDecode(bool enabled) { _lazyDecode.store(enabled); }
+    bool getLazyDecode() const { return _lazyDecode.load(); }
+    
+    // DEVICE_OFF only: keep just per-block peaks on the next load - one pass through the
+    // file, no PCM store. The waveform draws; features and sync have nothing to read (render farm).
+    void setPeaksOnly(bool enabled) { _peaksOnlyLoad.store(enabled); }
+    bool getPeaksOnly() const { return _peaksOnlyLoad.load(); }
+    
+    // Lazy mode only: new blocks were decoded since the last generateWaveform()
+    bool waveformStale() const { return _peaksChanged.load(); }
+    
+    // Follow mode, for a file that is still being written (a bounce in progress). A
+    // watcher thread - inotify on Linux, polling elsewhere and on network shares -
+    // decodes only what was appended and adds it to the store and the peaks.
+    // A file rewritten rather than grown, or a store that can't be extended (compressed
+    // in memory, disk cache), is loaded again on that thread once the writer stops.
+    // takeFollowStatus() reports FOLLOW_RELOAD while that reload waits, FOLLOW_GREW once
+    // the store has grown or been reloaded. The file is followed while any owner (see
+    // attachOwner) asks for it; an owner's last detachOwner() withdraws its request.
+    enum FollowStatus { FOLLOW_UNCHANGED = 0, FOLLOW_GREW, FOLLOW_RELOAD };
+    void setFollowFile(const void* owner, bool enabled);
+    bool getFollowFile() const { return _followFile.load(); }
+    FollowStatus takeFollowStatus() { return (FollowStatus)_followStatus.exchange(FOLLOW_UNCHANGED); }
     
-    // Waveform
+    // Waveform - one peak lane per channel
     void generateWaveform(int pixelWidth);
-    float* getWaveformL() { return waveformDataL; }
-    float* getWaveformR() { return waveformDataR; }
+    const float* getWaveform(int channel) const;
+    const float* getWaveformL() const { return getWaveform(0); }
+    const float* getWaveformR() const { return getWaveform(_channels >= 2 ? 1 : 0); }
     int getWaveformWidth() const { return waveformWidth; }
     
+    // Per-frame features (RMS, peak, band energies). Not built at load - computeFeatures()
+    // reads the whole file, so only the main handler's bake asks for it.
+    enum Feature { FEATURE_RMS = 0, FEATURE_PEAK, FEATURE_LOW, FEATURE_MID, FEATURE_HIGH, FEATURE_COUNT };
+    void computeFeatures();
+    float getFeature(int feature, int frame) const;
+    int getFeatureFrameCount() const { return _featureFrames; }
+    
+    // Mixer: more files heard together with this one, each with its own whole-frame
+    // offset relative to it (+ delays), gain and mute. Tracks are summed inside this
+    // file's data source, so a scrub stays one seek and one start however many there
+    // are. Track 0 is this file; added tracks count up from 1 and keep their index
+    // until removed. A track belongs to an owner (a node) and its slot - setTrack()
+    // only loads when the slot's file changes, an empty name removes it. The owner's
+    // last detachOwner() removes all of its tracks.
+    static const int MAX_TRACKS = 8;
+    int setTrack(const void* owner, int slot, const char* fileName);  // track index, -1 when empty or failed
+    void attachOwner(const void* owner);
+    void detachOwner(const void* owner);
+    void clearTracks();
+    int getTrackCount() const { return 1 + _trackCount.load(); }    // including removed tracks' gaps
+    void setTrackGain(int track, float gain);
+    void setTrackMute(int track, bool mute);
+    void setTrackOffset(int track, int frames);
+    int getMixLengthInFrames() const;           // to the end of the last track
+    // A track's peaks lined up with this file's waveform - side 0 = L, 1 = R
+    const float* getTrackWaveform(int track, int side) const;
+    
+    // Runtime counters - relaxed atomics, cheap enough for the scrub path and audio thread
+    struct Stats
+    {
+        double loadMs;              // last loadFile, decode included
+        ma_uint64 decodedBytes;     // PCM decoded from the file since load (lazy: grows with scrubbing)
+        ma_uint64 pcmBytes;         // PCM resident in RAM or mapped from the disk cache
+        ma_uint64 waveformBytes;    // waveform lanes, feature table, lazy block peaks
+        ma_uint64 playCalls;        // playAtFrame calls
+        ma_uint64 skippedFrames;    // calls that played nothing - same frame or past the end
+        ma_uint64 coalescedFrames;  // grains replaced while still playing
+        ma_uint64 lockWaits;        // playAtFrame calls that found the handler busy
+        double lockWaitMs;          // total time those calls waited
+        ma_uint64 underruns;        // device callbacks slower than real time, or late
+    };
+    Stats getStats() const;
+    void resetStats();              // scrub/device counters only - sizes and load time stay
+    
+    // Audio callback timing, to pick buffer sizes from data. Histogram bucket i
+    // counts values up to CALLBACK_HISTOGRAM_EDGES_US[i]; the last is open-ended.
+    static const int CALLBACK_HISTOGRAM_BUCKETS = 9;
+    static const int CALLBACK_HISTOGRAM_EDGES_US[CALLBACK_HISTOGRAM_BUCKETS - 1];
+    struct CallbackStats
+    {
+        ma_uint32 periodFrames;     // size of the last callback
+        ma_uint32 sampleRate;
+        ma_uint64 callbacks;
+        double meanMs;              // time spent mixing per callback
+        double maxMs;
+        double jitterMeanMs;        // |interval between callbacks - period|
+        double jitterMaxMs;
+        ma_uint64 underruns;
+        ma_uint64 interruptions;    // device notifications - miniaudio has none for xruns
+        ma_uint64 reroutes;
+        ma_uint64 durationHistogram[CALLBACK_HISTOGRAM_BUCKETS];
+        ma_uint64 jitterHistogram[CALLBACK_HISTOGRAM_BUCKETS];
+    };
+    CallbackStats getCallbackStats() const;
+    
+    // Audio callback size in frames. Changing it re-creates the device; a loaded
+    // file stays loaded. Auto-tune starts at the size saved for this host (else the
+    // platform default), doubles on repeated underruns and halves again after a long
+    // clean stretch - never below the default on Windows. A size that has run clean
+    // that long is saved. Its device restarts wait for a pause in scrubbing.
+    static const ma_uint32 MIN_PERIOD_FRAMES = 64;
+    static const ma_uint32 MAX_PERIOD_FRAMES = 4096;
+    static ma_uint32 defaultPeriodFrames();     // 128, 512 on Windows
+    bool setPeriodFrames(ma_uint32 frames);
+    ma_uint32 getPeriodFrames() const { return _periodFrames.load(); }
+    void setAutoTunePeriod(bool enabled);
+    bool getAutoTunePeriod() const { return _autoTunePeriod.load(); }
+    
     // Info
     bool fileLoaded() const { return _fileLoaded.load(); }
     void setFileLoaded(bool loaded) { _fileLoaded.store(loaded); }
     int getFileLengthInFrames() const;
     float getFps() const { return _fps; }
+    ma_uint32 getFpsNumerator() const { return _fpsNum; }
+    ma_uint32 getFpsDenominator() const { return _fpsDen; }
+    ma_uint32 getSampleRate() const { return _sampleRate; }
 
 private:
+    DeviceMode _deviceMode;
+    ma_context* _context;
     ma_engine* _engine;
     ma_sound* _sound;
     ma_decoder* _decoder;
+    PcmSource* _source;
     
     std::atomic<bool> _initialized;
+    bool _initFailed;
     std::atomic<bool> _fileLoaded;
     std::atomic<int> _lastPlayedFrame;
+    std::atomic<int> _soloChannel;
     
     std::string _currentFile;
     std::mutex _mutex;
     
-    ma_uint32 _sampleRate;
+    // What the store was decoded from - a load of the same, untouched file reuses it
+    ma_uint64 _fileSize;
+    ma_int64 _fileTime;
+    ma_uint64 _fileHash;
+    bool _loadedCompress;
+    Timecode _timecode;
+    
+    ma_uint32 _engineSampleRate;
+    ma_uint32 _sampleRate;      // file's native rate - ma_sound resamples on playback
     ma_uint32 _channels;
     ma_uint64 _totalPcmFrames;
     
+    // Frame rate as an exact ratio - frame boundaries are integer sample positions
     float _fps;
+    ma_uint32 _fpsNum;
+    ma_uint32 _fpsDen;
+    std::atomic<int> _lengthInFrames;
+    std::vector<ma_uint64> _frameStarts;    // first file sample of each frame, length + 1 entries
+    ma_int64 _subFrameOffsetSamples;
+    double _subFrameOffsetMs;
+    bool _subFrameOffsetInMs;
     
-    float* waveformDataL;
-    float* waveformDataR;
+    // Channel-major: [channel * waveformWidth + x]
+    std::vector<float> _waveform;
     int waveformWidth;
-    std::vector<float> _audioData;
+    
+    // Decoded PCM, interleaved at the file's native channel count and sample
+    // format (ma_format: s16 / s24 packed / s32 / f32 ...) - converted on read
+    std::vector<std::uint8_t> _audioData;
+    MappedFile* _mapped;            // disk-cache mapping, used instead of _audioData
+    const std::uint8_t* _pcm;       // whichever of the two holds the samples
+    int _sampleFormat;
+    ma_uint32 _bytesPerFrame;
+    
+    // Block-backed store (replaces _audioData when compressed or lazy). Blocks are
+    // PCM_BLOCK_FRAMES frames each and decode independently - from _blockData when
+    // compressed, straight from the file via _decoder when lazy.
+    struct CachedBlock
+    {
+        size_t block;
+        ma_uint64 lastUse;
+        std::shared_ptr<std::vector<std::uint8_t>> pcm;
+    };
+    
+    std::atomic<bool> _compressPcm;
+    bool _compressed;
+    std::vector<std::uint8_t> _blockData;
+    std::vector<size_t> _blockOffsets;      // block count + 1 entries
+    std::vector<CachedBlock> _blockCache;   // LRU of decoded blocks
+    size_t _blockCacheCapacity;
+    ma_uint64 _blockClock;
+    std::mutex _blockMutex;
+    
+    // Blocks the audio thread found missing - it plays silence and _loadThread decodes
+    // them. The thread holds _loadMutex while decoding, so clearPcm waits it out.
+    std::vector<size_t> _loadQueue;
+    std::mutex _loadMutex;
+    std::condition_variable _loadWake;
+    bool _loadStop;
+    std::thread _loadThread;
+    
+    std::atomic<bool> _lazyDecode;
+    bool _lazy;
+    std::mutex _decoderMutex;
+    std::atomic<bool> _peaksOnlyLoad;
+    bool _peaksOnly;
+    bool peaksOnlyLoad() const { return _peaksOnlyLoad.load() && _deviceMode == DEVICE_OFF; }
+    
+    // Lazy mode waveform source: per-block, per-channel peak, -1 until decoded
+    std::vector<float> _blockPeaks;
+    std::atomic<bool> _peaksChanged;
+    
+    // Per-channel gains for the stereo downmix, from the file's channel map
+    std::vector<float> _downmixL;
+    std::vector<float> _downmixR;
+    
+    // Interleaved per video frame: [frame * FEATURE_COUNT + feature]
+    std::vector<float> _features;
+    int _featureFrames;
+    
+    std::atomic<double> _statLoadMs;
+    std::atomic<ma_uint64> _statDecodedBytes;
+    std::atomic<ma_uint64> _statPcmBytes;
+    std::atomic<ma_uint64> _statWaveformBytes;
+    std::atomic<ma_uint64> _statPlayCalls;
+    std::atomic<ma_uint64> _statSkipped;
+    std::atomic<ma_uint64> _statCoalesced;
+    std::atomic<ma_uint64> _statLockWaits;
+    std::atomic<ma_uint64> _statLockWaitNs;
+    std::atomic<ma_uint64> _statUnderruns;
+    std::atomic<long long> _lastCallbackNs;
+    
+    // Written by the audio thread only
+    std::atomic<ma_uint32> _cbPeriodFrames;
+    std::atomic<ma_uint32> _cbSampleRate;
+    std::atomic<ma_uint64> _cbCount;
+    std::atomic<ma_uint64> _cbIntervals;
+    std::atomic<ma_uint64> _cbTotalNs;
+    std::atomic<ma_uint64> _cbMaxNs;
+    std::atomic<ma_uint64> _cbJitterTotalNs;
+    std::atomic<ma_uint64> _cbJitterMaxNs;
+    std::atomic<ma_uint64> _cbInterruptions;
+    std::atomic<ma_uint64> _cbReroutes;
+    std::atomic<ma_uint64> _cbDurationHist[CALLBACK_HISTOGRAM_BUCKETS];
+    std::atomic<ma_uint64> _cbJitterHist[CALLBACK_HISTOGRAM_BUCKETS];
+    
+    // Mixer. The list only changes under both _mutex and _trackMutex, so either one
+    // is enough to read it - the audio thread only ever tries _trackMutex. Removed
+    // tracks leave a null until the index is reused.
+    std::vector<std::unique_ptr<MixTrack>> _tracks;
+    std::vector<std::pair<const void*, int>> _owners;  // owner, users
+    std::mutex _trackMutex;
+    std::atomic<int> _trackCount;
+    std::atomic<float> _trackGain[MAX_TRACKS];  // by track number, 0 = this file - fixed slots,
+    std::atomic<bool> _trackMute[MAX_TRACKS];   // so setting them takes no lock
+    std::atomic<ma_uint64> _mixPcmFrames;   // this file's frames up to the end of the last track
+    std::vector<float> _trackWaveform;      // [((track - 1) * 2 + side) * waveformWidth + x]
+    
+    // Sequence list - stands in for the PCM store, stereo f32 at the first segment's rate.
+    // Segments open and close under both _mutex and _trackMutex, like mixer tracks, and
+    // the audio thread skips a callback rather than wait for one to be swapped.
+    std::vector<std::unique_ptr<SequenceSegment>> _segments;
+    bool _isSequence;
+    ma_uint64 _segmentClock;
+    
+    // Follow mode. The watcher is the only thing that changes the store's length while
+    // it runs - loads stop it first. _watchMutex is never taken with _mutex held.
+    std::atomic<bool> _followFile;
+    std::atomic<int> _followStatus;
+    FileWatch* _watch;
+    std::mutex _watchMutex;
+    std::vector<const void*> _followOwners;
+    std::mutex _followOwnerMutex;           // held over starting or stopping the watcher
+    
+    std::atomic<ma_uint32> _periodFrames;
+    std::atomic<bool> _autoTunePeriod;
+    std::mutex _tuneMutex;
+    ma_uint64 _tuneCallbacks;       // counters at the start of the tuning window
+    ma_uint64 _tuneUnderruns;
+    ma_uint32 _tuneCleanWindows;    // in a row at the current size
+    ma_uint32 _tuneFailedFrames;    // largest size that underran this session - no stepping down to it
+    ma_uint32 _tuneSettledFrames;   // saved for this host, 0 if none
+    std::atomic<ma_uint32> _tunePendingFrames;  // picked, waiting for a pause - 0 if none
+    std::atomic<bool> _tuneStop;
+    std::thread _tuneThread;
+    std::atomic<long long> _lastPlayNs;
+    
+    friend struct PcmSource;
+    friend struct EngineHost;
+    void deviceCallback(void* out, ma_uint32 frameCount, ma_uint32 sampleRate);
+    void deviceNotification(int type);
+    void lockTimed(std::unique_lock<std::mutex>& lock);
+    void updateWaveformStats();
+    void applyFps(ma_uint32 numerator, ma_uint32 denominator);
+    void buildFrameTable();
+    void timingChanged();
+    ma_uint64 frameStart(int frame) const;
+    ma_uint64 samplesAtFrame(int frame, ma_uint32 sampleRate) const;
+    ma_uint64 readMixed(ma_uint64 frame, float* out, ma_uint64 frameCount);
+    ma_uint64 readMix(ma_uint64 frame, float* out, ma_uint64 frameCount);
+    void updateTrackTiming();
+    int findTrack(const void* owner, int slot) const;
+    void buildTrackWaveforms();
+    static void mixSource(AudioHandler& source, double rateRatio, double offset, float gain, float* scratch,
+                          ma_uint64 frame, float* out, ma_uint64 frameCount);
+    bool loadSequence(const char* listFile, std::uint8_t* channelMap);
+    void updateSequenceTiming();
+    bool openSegment(size_t index);
+    void prepareSegments(ma_uint64 firstFrame, ma_uint64 frameCount);
+    void readSequence(ma_uint64 frame, float* out, ma_uint64 frameCount);
+    void sequenceWaveform(int pixelWidth);
+    void startFollowing();
+    void stopFollowing();
+    void followLoop(FileWatch* watch, std::string path);
+    FollowStatus appendTail(const std::string& path);
+    void scanBlockPeaks(size_t firstBlock);
+    bool openFile(const char* fileName, float fps);
+    bool reuseLoaded(const char* fileName, float fps);
+    // An analysis pass's own last block - whole-file reads go through it instead of the
+    // playback cache, so they can't evict what the audio thread is about to read
+    struct BlockCursor
+    {
+        size_t block = (size_t)-1;
+        std::shared_ptr<std::vector<std::uint8_t>> pcm;
+    };
+    void readFloat(ma_uint64 frame, float* out, ma_uint64 frameCount, BlockCursor* cursor = nullptr);
+    std::shared_ptr<std::vector<std::uint8_t>> getBlock(size_t block, bool cacheBlocks = true);
+    std::shared_ptr<std::vector<std::uint8_t>> cachedBlock(size_t block);
+    void requestBlock(size_t block);
+    void blockLoadLoop();
+    bool decodeFile(const char* fileName, std::uint8_t* channelMap);
+    bool decodeParallel(const char* fileName, ma_uint64* framesRead);
+    bool loadFromDiskCache(const char* fileName, std::uint8_t* channelMap);
+    void writeDiskCache(const char* fileName, const std::uint8_t* channelMap);
+    void compressPcm();
+    void decodeBlockFromFile(size_t block, std::uint8_t* pcm, ma_uint32 frames);
+    void prefetchBlocks(ma_uint64 firstFrame, ma_uint64 frameCount);
+    void clearPcm();
+    size_t pcmBytes() const;
+    void releaseSound();
+    bool createSound();
+    void releaseEngine();
+    bool restartEngine();
+    void autoTunePeriod();
+    void tuneRestartLoop();
     
     void cleanup();
+    void buildFeatures();
+    void extendFeatures(std::vector<float>&& kept, int keptFrames);
+    void buildFeatureRange(int firstFrame, int endFrame);
+    bool ensureEngine();
     bool initEngine();
 };
 
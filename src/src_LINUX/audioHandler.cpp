@@ -7,270 +7,4473 @@
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <thread>
+#include <cstring>
+#include <functional>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <numeric>
+#include <complex>
+#include <condition_variable>
 
-AudioHandler::AudioHandler()
-    : _engine(nullptr)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Feeds the engine from the decoded PCM store, mixed down to the engine's stereo output.
+// Cursor is only touched from the audio thread (ma_sound defers seeks to it).
+struct PcmSource
+{
+    ma_data_source_base base;
+    AudioHandler* handler;
+    ma_uint64 cursor;
+    
+    static ma_result onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead)
+    {
+        PcmSource* src = (PcmSource*)pDataSource;
+        ma_uint64 framesRead = src->handler->readMix(src->cursor, (float*)pFramesOut, frameCount);
+        src->cursor += framesRead;
+        
+        if (pFramesRead) *pFramesRead = framesRead;
+        return (framesRead < frameCount || framesRead == 0) ? MA_AT_END : MA_SUCCESS;
+    }
+    
+    static ma_result onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex)
+    {
+        PcmSource* src = (PcmSource*)pDataSource;
+        src->cursor = std::min(frameIndex, src->handler->_mixPcmFrames.load());
+        return MA_SUCCESS;
+    }
+    
+    static ma_result onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels,
+                                     ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap)
+    {
+        PcmSource* src = (PcmSource*)pDataSource;
+        *pFormat = ma_format_f32;
+        *pChannels = 2;
+        *pSampleRate = src->handler->_sampleRate;
+        ma_channel_map_init_standard(ma_standard_channel_map_default, pChannelMap, channelMapCap, 2);
+        return MA_SUCCESS;
+    }
+    
+    static ma_result onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor)
+    {
+        *pCursor = ((PcmSource*)pDataSource)->cursor;
+        return MA_SUCCESS;
+    }
+    
+    static ma_result onGetLength(ma_data_source* pDataSource, ma_uint64* pLength)
+    {
+        *pLength = ((PcmSource*)pDataSource)->handler->_mixPcmFrames.load();
+        return MA_SUCCESS;
+    }
+};
+
+// ma_engine plus its handler. miniaudio passes the engine as the device's user
+// data, and the engine is the first member, so the callback can find its way back.
+struct EngineHost
+{
+    ma_engine engine;
+    AudioHandler* handler;
+    
+    static EngineHost* of(ma_engine* engine) { return reinterpret_cast<EngineHost*>(engine); }
+    
+    static void onData(ma_device* pDevice, void* pFramesOut, const void* pFramesIn, ma_uint32 frameCount)
+    {
+        (void)pFramesIn;
+        EngineHost* host = of((ma_engine*)pDevice->pUserData);
+        host->handler->deviceCallback(pFramesOut, frameCount, pDevice->sampleRate);
+    }
+    
+    static void onNotification(const ma_device_notification* pNotification)
+    {
+        EngineHost* host = of((ma_engine*)pNotification->pDevice->pUserData);
+        host->handler->deviceNotification((int)pNotification->type);
+    }
+};
+
+// One mixer track: its own decoded file (never plays by itself) plus the mix settings
+// the audio thread reads. Rates that differ from the main file are resampled linearly.
+static const ma_uint64 MIX_CHUNK_FRAMES = 1024;
+
+// Stereo floats mixSource needs per chunk - a whole chunk at the same rate, or the
+// span one chunk covers when resampling, plus the interpolation neighbours
+static size_t mixScratchFloats(double rateRatio)
+{
+    return (size_t)(MIX_CHUNK_FRAMES * std::max(1.0, rateRatio) + 4) * 2;
+}
+
+struct MixTrack
+{
+    std::unique_ptr<AudioHandler> handler;
+    const void* owner = nullptr;                // the node and mixer slot it was loaded for
+    int slot = -1;
+    std::string path;
+    double rateRatio = 1.0;                     // track samples per main-file sample
+    std::atomic<int> offsetFrames{ 0 };
+    std::atomic<ma_int64> offsetSamples{ 0 };   // at the track's rate
+    std::vector<float> scratch;                 // audio thread only
+};
+
+// One line of a sequence list. The file opens (decode on demand) when the playhead
+// gets near and closes again once it's among the least recently used.
+static const size_t SEQUENCE_OPEN_SEGMENTS = 4;
+
+struct SequenceSegment
+{
+    std::string path;
+    int recordIn = 0;                           // sequence frames, earliest record in = 0
+    int recordOut = 0;
+    int sourceIn = 0;                           // frames into the file
+    ma_uint64 recordStart = 0;                  // timeline samples
+    ma_uint64 recordEnd = 0;
+    std::unique_ptr<AudioHandler> handler;      // null until opened
+    bool failed = false;                        // don't retry a missing file on every scrub
+    double rateRatio = 1.0;                     // file samples per timeline sample
+    double offset = 0.0;                        // file sample = timeline sample * rateRatio - offset
+    std::vector<float> scratch;
+    ma_uint64 lastUse = 0;
+};
+
+// Follow mode watcher. inotify wakes it as soon as the writer touches the file; the
+// poll interval still rescans, for network shares where remote writes raise no events.
+static const int FOLLOW_POLL_MS = 500;
+static const int FOLLOW_RESCAN_MS = 2000;
+static const int FOLLOW_SETTLE_MS = 1000;       // a rewritten file must hold still this long before it is reloaded
+static const ma_uint64 FOLLOW_CHECK_FRAMES = 256;  // re-decoded before the old end to spot a rewrite
+
+struct FileWatch
+{
+    std::thread thread;
+    std::atomic<bool> stop{ false };
+#ifdef __linux__
+    int wakeFd = -1;                            // eventfd - interrupts poll() on stop
+#else
+    std::mutex mutex;
+    std::condition_variable wake;
+#endif
+    
+    // Sleeps for up to ms, or until stop is set
+    void sleep(int ms)
+    {
+#ifdef __linux__
+        pollfd fd = { wakeFd, POLLIN, 0 };
+        poll(&fd, 1, ms);
+#else
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return stop.load(); });
+#endif
+    }
+    
+    void requestStop()
+    {
+        stop.store(true);
+#ifdef __linux__
+        eventfd_write(wakeFd, 1);
+#else
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_all();
+#endif
+    }
+};
+
+// Bound by reference in std::min/max - they need storage outside optimized builds
+const ma_uint32 AudioHandler::MIN_PERIOD_FRAMES;
+const ma_uint32 AudioHandler::MAX_PERIOD_FRAMES;
+const int AudioHandler::MAX_TRACKS;
+
+const int AudioHandler::CALLBACK_HISTOGRAM_EDGES_US[AudioHandler::CALLBACK_HISTOGRAM_BUCKETS - 1] = {
+    50, 100, 250, 500, 1000, 2000, 5000, 10000
+};
+
+static int callbackHistogramBucket(long long ns)
+{
+    int bucket = 0;
+    while (bucket < AudioHandler::CALLBACK_HISTOGRAM_BUCKETS - 1 &&
+           ns > AudioHandler::CALLBACK_HISTOGRAM_EDGES_US[bucket] * 1000LL) {
+        bucket++;
+    }
+    return bucket;
+}
+
+static inline long long steadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static ma_data_source_vtable g_pcmSourceVtable = {
+    PcmSource::onRead,
+    PcmSource::onSeek,
+    PcmSource::onGetDataFormat,
+    PcmSource::onGetCursor,
+    PcmSource::onGetLength,
+    nullptr,
+    0
+};
+
+// Runs fn(first, end) over [0, count) split into one range per core
+static void parallelRanges(size_t count, size_t minPerThread, const std::function<void(size_t, size_t)>& fn)
+{
+    if (count == 0) return;
+    
+    size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::max(size_t(1), std::min(numThreads, (count + minPerThread - 1) / minPerThread));
+    size_t perThread = (count + numThreads - 1) / numThreads;
+    
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < numThreads; t++) {
+        size_t first = t * perThread;
+        size_t end = std::min(count, first + perThread);
+        if (first < end) workers.emplace_back(fn, first, end);
+    }
+    fn(0, std::min(count, perThread));
+    
+    for (auto& worker : workers) worker.join();
+}
+
+// Knob values like 23.976 stand for the NTSC x1000/1001 rates - anything else
+// is taken to the nearest 1/1000 fps
+static void rationalFps(float fps, ma_uint32& numerator, ma_uint32& denominator)
+{
+    static const int ntscBases[] = { 24, 30, 48, 60, 120, 240 };
+    for (int base : ntscBases) {
+        if (std::fabs(fps - base * 1000.0 / 1001.0) < 0.005) {
+            numerator = (ma_uint32)base * 1000;
+            denominator = 1001;
+            return;
+        }
+    }
+    
+    numerator = (ma_uint32)std::max(1L, std::lround(fps * 1000.0));
+    denominator = 1000;
+    ma_uint32 divisor = std::gcd(numerator, denominator);
+    numerator /= divisor;
+    denominator /= divisor;
+}
+
+// Lower-case extension without the dot, empty if none
+static std::string fileExtension(const char* fileName)
+{
+    std::string ext = fileName;
+    size_t dot = ext.find_last_of('.');
+    if (dot == std::string::npos) return std::string();
+    
+    ext = ext.substr(dot + 1);
+    for (auto& ch : ext) ch = (char)std::tolower((unsigned char)ch);
+    return ext;
+}
+
+// MP3/FLAC/OGG cost real CPU to decode - worth splitting across threads
+static bool isCompressedFormat(const char* fileName)
+{
+    std::string ext = fileExtension(fileName);
+    return ext == "mp3" || ext == "flac" || ext == "ogg";
+}
+
+static bool isSequenceList(const char* fileName)
+{
+    std::string ext = fileExtension(fileName);
+    return ext == "txt" || ext == "seq";
+}
+
+// Frame count or HH:MM:SS:FF timecode at a nominal rate. ';' before the frames marks
+// drop-frame (29.97 / 59.94), which skips frame numbers at most minute starts.
+// The whole token must match - no signs, spaces or trailing text.
+static bool parseSequenceTime(const std::string& text, int nominalFps, int& frames)
+{
+    auto digits = [&text](size_t first, size_t count, int& value) {
+        if (count == 0 || count > 9 || first + count > text.size()) return false;
+        value = 0;
+        for (size_t i = first; i < first + count; i++) {
+            if (text[i] < '0' || text[i] > '9') return false;
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+    
+    if (text.find(':') == std::string::npos && text.find(';') == std::string::npos) {
+        return digits(0, text.size(), frames);
+    }
+    
+    int hh, mm, ss, ff;
+    if (text.size() != 11 || text[2] != ':' || text[5] != ':' || (text[8] != ':' && text[8] != ';')) return false;
+    if (!digits(0, 2, hh) || !digits(3, 2, mm) || !digits(6, 2, ss) || !digits(9, 2, ff)) return false;
+    if (hh > 23 || mm > 59 || ss > 59 || ff >= nominalFps) return false;
+    
+    frames = ((hh * 60 + mm) * 60 + ss) * nominalFps + ff;
+    if (text[8] == ';' && nominalFps % 30 == 0) {
+        int dropped = nominalFps / 15;
+        int minutes = hh * 60 + mm;
+        if (ss == 0 && ff < dropped && minutes % 10 != 0) return false;     // numbers that were skipped
+        frames -= dropped * (minutes - minutes / 10);
+    }
+    return true;
+}
+
+// ============================================================================
+// Chrome trace events (AUDIOPLAYER_TRACE)
+// Each thread appends to its own chain of fixed-size chunks - no locks on the
+// recording path; the count is published with release so traceFlush() can read
+// a consistent prefix while threads keep recording. Chunks are kept until exit,
+// so events of threads that have finished (parallel decode) survive. The log is
+// never destroyed - Nuke's threads may still be recording while statics unwind.
+// ============================================================================
+static const size_t TRACE_CHUNK_EVENTS = 4096;
+static const size_t TRACE_MAX_EVENTS = 4 * 1024 * 1024;     // ~100 MB, then new scopes are dropped
+
+struct TraceEvent
+{
+    const char* name;
+    long long ns;
+    char phase;     // 'B' or 'E'
+};
+
+struct TraceChunk
+{
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    std::atomic<size_t> count{0};
+    std::atomic<TraceChunk*> next{nullptr};
+};
+
+struct TraceThread
+{
+    int tid;
+    TraceChunk* head;
+    TraceChunk* tail;   // only touched by the owning thread
+};
+
+struct TraceLog
+{
+    std::string path;
+    long long startNs;
+    std::atomic<size_t> events{0};
+    std::mutex mutex;   // thread registration and flushing only
+    std::vector<std::unique_ptr<TraceThread>> threads;
+    
+    TraceLog()
+    {
+        const char* env = std::getenv("AUDIOPLAYER_TRACE");
+        if (env && env[0]) path = env;
+        startNs = steadyNs();
+    }
+    
+    TraceThread* registerThread()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(std::unique_ptr<TraceThread>(new TraceThread()));
+        TraceThread* thread = threads.back().get();
+        thread->tid = (int)threads.size();
+        thread->head = thread->tail = new TraceChunk();
+        return thread;
+    }
+};
+
+static TraceLog& traceLog()
+{
+    static TraceLog* log = new TraceLog();
+    return *log;
+}
+
+bool traceEnabled()
+{
+    static const bool enabled = []() {
+        if (traceLog().path.empty()) return false;
+        std::atexit([]() { traceFlush(); });
+        std::cout << "AudioHandler: Tracing to " << traceLog().path << std::endl;
+        return true;
+    }();
+    return enabled;
+}
+
+static bool traceRecord(const char* name, char phase)
+{
+    // A begin takes room for its end too, so the cap never leaves a scope open
+    TraceLog& log = traceLog();
+    if (phase == 'B' && log.events.fetch_add(2, std::memory_order_relaxed) >= TRACE_MAX_EVENTS - 1) return false;
+    
+    thread_local TraceThread* thread = log.registerThread();
+    
+    TraceChunk* chunk = thread->tail;
+    size_t n = chunk->count.load(std::memory_order_relaxed);
+    if (n == TRACE_CHUNK_EVENTS) {
+        TraceChunk* fresh = new TraceChunk();
+        chunk->next.store(fresh, std::memory_order_release);
+        thread->tail = chunk = fresh;
+        n = 0;
+    }
+    
+    chunk->events[n] = { name, steadyNs(), phase };
+    chunk->count.store(n + 1, std::memory_order_release);
+    return true;
+}
+
+TraceScope::TraceScope(const char* name)
+    : _name(name)
+    , _active(traceEnabled() && traceRecord(name, 'B'))
+{
+}
+
+TraceScope::~TraceScope()
+{
+    if (_active) traceRecord(_name, 'E');
+}
+
+// Rewrites the whole file with everything recorded so far
+bool traceFlush()
+{
+    if (!traceEnabled()) return false;
+    
+    TraceLog& log = traceLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    
+    FILE* file = std::fopen(log.path.c_str(), "w");
+    if (!file) {
+        std::cerr << "AudioHandler: Cannot write trace " << log.path << std::endl;
+        return false;
+    }
+    
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    size_t written = 0;
+    
+    for (auto& thread : log.threads) {
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                     first ? "" : ",\n", thread->tid, thread->tid);
+        first = false;
+        
+        for (TraceChunk* chunk = thread->head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+            size_t count = chunk->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; i++) {
+                const TraceEvent& e = chunk->events[i];
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                             e.name, e.phase, (e.ns - log.startNs) / 1000.0, thread->tid);
+            }
+            written += count;
+        }
+    }
+    
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+    
+    std::cout << "AudioHandler: Wrote " << written << " trace events to " << log.path << std::endl;
+    return true;
+}
+
+// ============================================================================
+// Per-host audio buffer size, remembered by the period auto-tune.
+// One "<host> <frames>" line per machine, so a shared home directory works.
+// ============================================================================
+static const ma_uint64 AUTOTUNE_WINDOW_SECONDS = 2;
+static const ma_uint64 AUTOTUNE_UNDERRUNS = 3;      // per window, to double the period
+static const ma_uint32 AUTOTUNE_SETTLE_WINDOWS = 15; // clean windows in a row to save a size or halve it
+static const long long AUTOTUNE_IDLE_MS = 250;      // no scrub for this long before the device is re-created
+
+// Starting callback size before any tuning
+ma_uint32 AudioHandler::defaultPeriodFrames()
+{
+#ifdef _WIN32
+    return 512;     // WASAPI glitches and can freeze with smaller buffers
+#else
+    return 128;     // Very low latency for scrubbing
+#endif
+}
+
+// Auto-tune never steps below this. WASAPI's trouble with small buffers
+// isn't always an underrun - it can freeze instead.
+static ma_uint32 lowestTunedPeriod()
+{
+#ifdef _WIN32
+    return AudioHandler::defaultPeriodFrames();
+#else
+    return AudioHandler::MIN_PERIOD_FRAMES;
+#endif
+}
+
+static fs::path hostPeriodFile()
+{
+#ifdef _WIN32
+    const char* base = std::getenv("LOCALAPPDATA");
+    return fs::path(base ? base : ".") / "AudioPlayer" / "audio_buffer.cfg";
+#else
+    const char* base = std::getenv("HOME");
+    return fs::path(base ? base : "/tmp") / ".nuke" / "audioplayer_buffer.cfg";
+#endif
+}
+
+static std::string hostName()
+{
+    char name[256] = {};
+#ifdef _WIN32
+    DWORD size = sizeof(name);
+    if (GetComputerNameA(name, &size)) return name;
+#else
+    if (gethostname(name, sizeof(name) - 1) == 0 && name[0]) return name;
+#endif
+    return "localhost";
+}
+
+// 0 when this host hasn't tuned yet
+static ma_uint32 loadHostPeriod()
+{
+    std::ifstream in(hostPeriodFile());
+    std::string host, self = hostName();
+    ma_uint32 frames = 0;
+    
+    while (in >> host >> frames) {
+        if (host == self) return frames;
+    }
+    return 0;
+}
+
+static void saveHostPeriod(ma_uint32 frames)
+{
+    fs::path file = hostPeriodFile();
+    std::string self = hostName();
+    std::vector<std::pair<std::string, ma_uint32>> entries;
+    
+    {
+        std::ifstream in(file);
+        std::string host;
+        ma_uint32 value = 0;
+        while (in >> host >> value) {
+            if (host != self) entries.push_back({ host, value });
+        }
+    }
+    entries.push_back({ self, frames });
+    
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    std::ofstream out(file, std::ios::trunc);
+    for (auto& entry : entries) {
+        out << entry.first << " " << entry.second << "\n";
+    }
+    if (!out) {
+        std::cerr << "AudioHandler: Cannot save audio buffer size to " << file.string() << std::endl;
+    }
+}
+
+// AUDIOPLAYER_SCRUB_LOG=<file>: append "<ms> <frame>" per playAtFrame request,
+// a trace that bench/scrubReplay can play back against a build
+static void logScrubRequest(int frame)
+{
+    struct ScrubLog
+    {
+        FILE* file = nullptr;
+        std::mutex mutex;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        ScrubLog()
+        {
+            if (const char* path = std::getenv("AUDIOPLAYER_SCRUB_LOG")) {
+                file = std::fopen(path, "w");
+                if (file) std::fprintf(file, "# AudioPlayer scrub trace: <ms> <frame>\n");
+            }
+        }
+        ~ScrubLog() { if (file) std::fclose(file); }
+    };
+    static ScrubLog log;
+    
+    if (!log.file) return;
+    
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - log.start).count();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    std::fprintf(log.file, "%.3f %d\n", ms, frame);
+    std::fflush(log.file);
+}
+
+// ============================================================================
+// Decoded-PCM disk cache for compressed sources
+// <cache dir>/<key>.pcm = header + channel map + raw PCM, memory-mapped on reuse.
+// Key is path + size + mtime; least recently used files go once over the cap.
+//   AUDIOPLAYER_CACHE_DIR  cache location (default ~/.nuke/audioplayer_cache)
+//   AUDIOPLAYER_CACHE_MB   size cap, 0 disables the cache (default 4096)
+// ============================================================================
+struct PcmCacheHeader
+{
+    char magic[4];          // "APCM"
+    ma_uint32 version;
+    ma_uint32 format;
+    ma_uint32 channels;
+    ma_uint32 sampleRate;
+    ma_uint32 dataOffset;   // header + channel map, rounded up for alignment
+    ma_uint64 frameCount;
+    ma_uint64 sourceSize;
+    ma_int64 sourceMtime;
+};
+
+static const ma_uint32 PCM_CACHE_VERSION = 1;
+static const ma_uint64 PCM_CACHE_DEFAULT_MB = 4096;
+
+static fs::path pcmCacheDir()
+{
+    if (const char* dir = std::getenv("AUDIOPLAYER_CACHE_DIR")) return fs::path(dir);
+#ifdef _WIN32
+    const char* base = std::getenv("LOCALAPPDATA");
+    return fs::path(base ? base : ".") / "AudioPlayer" / "cache";
+#else
+    const char* base = std::getenv("HOME");
+    return fs::path(base ? base : "/tmp") / ".nuke" / "audioplayer_cache";
+#endif
+}
+
+static ma_uint64 pcmCacheCapBytes()
+{
+    ma_uint64 mb = PCM_CACHE_DEFAULT_MB;
+    if (const char* env = std::getenv("AUDIOPLAYER_CACHE_MB")) mb = std::strtoull(env, nullptr, 10);
+    return mb * 1024 * 1024;
+}
+
+// Cache file for this source, or false if the source can't be stat'ed
+static bool pcmCacheEntry(const char* fileName, fs::path& cacheFile, ma_uint64& size, ma_int64& mtime)
+{
+    std::error_code ec;
+    fs::path source = fs::absolute(fs::path(fileName), ec);
+    if (ec) return false;
+    
+    size = (ma_uint64)fs::file_size(source, ec);
+    if (ec) return false;
+    mtime = (ma_int64)fs::last_write_time(source, ec).time_since_epoch().count();
+    if (ec) return false;
+    
+    // FNV-1a over path, size and mtime
+    ma_uint64 hash = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t n) {
+        const std::uint8_t* p = (const std::uint8_t*)data;
+        for (size_t i = 0; i < n; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+    };
+    std::string path = source.generic_string();
+    mix(path.data(), path.size());
+    mix(&size, sizeof(size));
+    mix(&mtime, sizeof(mtime));
+    
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.pcm", (unsigned long long)hash);
+    cacheFile = pcmCacheDir() / name;
+    return true;
+}
+
+// Size, modification time and a content hash - FNV-1a over the start of the file (headers),
+// its last bytes and a few blocks spread between, so a rewrite that keeps size and mtime
+// is still caught without reading the whole file
+static const size_t STAMP_BLOCK_BYTES = 4096;
+static const int STAMP_SAMPLED_BLOCKS = 16;
+
+static bool fileStamp(const char* fileName, ma_uint64& size, ma_int64& mtime, ma_uint64& contentHash)
+{
+    std::error_code ec;
+    size = (ma_uint64)fs::file_size(fs::path(fileName), ec);
+    if (ec) return false;
+    mtime = (ma_int64)fs::last_write_time(fs::path(fileName), ec).time_since_epoch().count();
+    if (ec) return false;
+    
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in) return false;
+    
+    contentHash = 14695981039346656037ull;
+    std::vector<char> buffer(16 * STAMP_BLOCK_BYTES);
+    auto mix = [&](ma_uint64 offset, size_t bytes) {
+        in.clear();
+        in.seekg((std::streamoff)offset);
+        in.read(buffer.data(), (std::streamsize)std::min<ma_uint64>(bytes, buffer.size()));
+        for (std::streamsize i = 0; i < in.gcount(); i++) contentHash = (contentHash ^ (std::uint8_t)buffer[i]) * 1099511628211ull;
+    };
+    
+    mix(0, buffer.size());
+    for (int i = 1; i <= STAMP_SAMPLED_BLOCKS; i++) {
+        mix(size * i / (STAMP_SAMPLED_BLOCKS + 1), STAMP_BLOCK_BYTES);
+    }
+    mix(size > STAMP_BLOCK_BYTES ? size - STAMP_BLOCK_BYTES : 0, STAMP_BLOCK_BYTES);
+    return true;
+}
+
+// Drop least recently used cache files until the directory fits under the cap
+static void trimPcmCache(const fs::path& dir, ma_uint64 capBytes)
+{
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    ma_uint64 total = 0;
+    
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != ".pcm") continue;
+        total += (ma_uint64)it->file_size(ec);
+        files.emplace_back(it->last_write_time(ec), it->path());
+    }
+    
+    std::sort(files.begin(), files.end());
+    for (auto& file : files) {
+        if (total <= capBytes) break;
+        ma_uint64 size = (ma_uint64)fs::file_size(file.second, ec);
+        // Fails on Windows while another session has it mapped - skip it then
+        if (fs::remove(file.second, ec)) total -= size;
+    }
+}
+
+// Read-only memory mapping of a cache file
+struct MappedFile
+{
+    const std::uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    
+    bool map(const fs::path& path)
+    {
+#ifdef _WIN32
+        file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            size = (size_t)fileSize.QuadPart;
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) data = (const std::uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = (size_t)st.st_size;
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) data = (const std::uint8_t*)p;
+        }
+#endif
+        if (!data) unmap();
+        return data != nullptr;
+    }
+    
+    void unmap()
+    {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+    
+    ~MappedFile() { unmap(); }
+};
+
+// ============================================================================
+// QuickTime / MP4 PCM audio
+// A miniaudio decoding backend for uncompressed audio tracks in MOV/MP4 files
+// (lpcm, sowt, twos, in24, in32, fl32), so plates and editorial references play
+// without extracting a WAV. Only moov is parsed; its chunk table maps PCM frames
+// to file offsets, so a seek is a binary search and reads go straight to mdat.
+// ============================================================================
+static const ma_uint64 MOV_MAX_MOOV_BYTES = 256ull * 1024 * 1024;
+
+struct MovChunk
+{
+    ma_uint64 offset;           // file position of the chunk's first frame
+    ma_uint64 firstFrame;
+    ma_uint64 frames;
+};
+
+struct MovPcmSource
+{
+    ma_data_source_base base;   // first - miniaudio casts to it
+    std::ifstream file;
+    std::vector<MovChunk> chunks;
+    ma_format format;           // as stored, after byte order is fixed up
+    ma_uint32 channels = 0;
+    ma_uint32 sampleRate = 0;
+    ma_uint32 bytesPerSample = 0;
+    bool bigEndian = false;
+    bool signedBytes = false;   // 8-bit 'twos' - flipped to miniaudio's unsigned u8
+    ma_uint64 totalFrames = 0;
+    ma_uint64 cursor = 0;
+    size_t chunk = 0;           // chunk of the last read - playback moves forward
+};
+
+static ma_uint32 movBe16(const std::uint8_t* p) { return ((ma_uint32)p[0] << 8) | p[1]; }
+static ma_uint32 movBe32(const std::uint8_t* p) { return ((ma_uint32)p[0] << 24) | ((ma_uint32)p[1] << 16) | ((ma_uint32)p[2] << 8) | p[3]; }
+static ma_uint64 movBe64(const std::uint8_t* p) { return ((ma_uint64)movBe32(p) << 32) | movBe32(p + 4); }
+
+// Calls fn(type, payload, payloadSize) for each box in [data, data + size). False on a malformed header.
+static bool movForEachBox(const std::uint8_t* data, size_t size, const std::function<void(const char*, const std::uint8_t*, size_t)>& fn)
+{
+    size_t pos = 0;
+    while (pos + 8 <= size) {
+        ma_uint64 boxSize = movBe32(data + pos);
+        size_t header = 8;
+        if (boxSize == 1) {
+            if (pos + 16 > size) return false;
+            boxSize = movBe64(data + pos + 8);
+            header = 16;
+        } else if (boxSize == 0) {
+            boxSize = size - pos;
+        }
+        if (boxSize < header || boxSize > size - pos) return false;
+        
+        char type[5] = { (char)data[pos + 4], (char)data[pos + 5], (char)data[pos + 6], (char)data[pos + 7], 0 };
+        fn(type, data + pos + header, (size_t)boxSize - header);
+        pos += (size_t)boxSize;
+    }
+    return true;
+}
+
+// The sound track's tables, gathered from trak/mdia/minf/stbl
+struct MovTrack
+{
+    bool sound = false;
+    ma_uint32 timescale = 0;
+    std::string codec;
+    ma_uint32 channels = 0;
+    ma_uint32 bitsPerSample = 0;
+    ma_uint32 sampleRate = 0;
+    ma_uint32 framesPerSample = 1;
+    bool isFloat = false;
+    bool signedInt = true;
+    bool bigEndian = true;
+    bool bigEndianKnown = false;    // lpcm flags or an 'enda' box said so
+    bool interleaved = true;
+    std::vector<ma_uint32> stsc;    // first chunk (1-based), samples per chunk - pairs
+    std::vector<ma_uint64> chunkOffsets;
+    ma_uint32 sampleSize = 0;
+    ma_uint64 sampleCount = 0;
+};
+
+static void movParseSampleEntry(const std::uint8_t* p, size_t size, MovTrack& track)
+{
+    // SoundDescription: 8 reserved/data-ref bytes, then version, revision, vendor,
+    // channels, sample size, compression id, packet size, 16.16 rate
+    if (size < 28) return;
+    ma_uint32 version = movBe16(p + 8);
+    track.channels = movBe16(p + 16);
+    track.bitsPerSample = movBe16(p + 18);
+    track.sampleRate = movBe32(p + 24) >> 16;
+    size_t extensions = 28;
+    
+    if (version == 1 && size >= 44) {
+        extensions = 44;                                    // + samples/bytes per packet, frame, sample
+    } else if (version == 2 && size >= 64) {
+        // Rate, channels and format flags move into a version 2 block
+        double rate;
+        ma_uint64 bits = movBe64(p + 32);
+        memcpy(&rate, &bits, sizeof(rate));
+        track.sampleRate = (ma_uint32)std::lround(rate);
+        track.channels = movBe32(p + 40);
+        track.bitsPerSample = movBe32(p + 48);
+        ma_uint32 flags = movBe32(p + 52);
+        track.isFloat = (flags & 1) != 0;
+        track.bigEndian = (flags & 2) != 0;
+        track.signedInt = (flags & 4) != 0;
+        track.bigEndianKnown = true;
+        track.interleaved = (flags & 32) == 0;
+        track.framesPerSample = std::max(1u, movBe32(p + 60));
+        extensions = 64;
+    }
+    
+    // in24/in32/fl32 are big-endian unless an 'enda' box (maybe inside 'wave') says otherwise
+    std::function<void(const char*, const std::uint8_t*, size_t)> child = [&](const char* type, const std::uint8_t* data, size_t bytes) {
+        if (strcmp(type, "wave") == 0) {
+            movForEachBox(data, bytes, child);
+        } else if (strcmp(type, "enda") == 0 && bytes >= 2) {
+            track.bigEndian = movBe16(data) == 0;
+            track.bigEndianKnown = true;
+        }
+    };
+    if (size > extensions) movForEachBox(p + extensions, size - extensions, child);
+}
+
+static void movParseTrak(const std::uint8_t* data, size_t size, MovTrack& track)
+{
+    movForEachBox(data, size, [&](const char* type, const std::uint8_t* p, size_t bytes) {
+        if (!strcmp(type, "mdia") || !strcmp(type, "minf") || !strcmp(type, "stbl")) {
+            movParseTrak(p, bytes, track);
+        } else if (!strcmp(type, "mdhd") && bytes >= 24) {
+            track.timescale = movBe32(p + (p[0] == 1 ? 20 : 12));
+        } else if (!strcmp(type, "hdlr") && bytes >= 12) {
+            track.sound = memcmp(p + 8, "soun", 4) == 0;
+        } else if (!strcmp(type, "stsd") && bytes >= 16) {
+            // First description only - PCM tracks don't switch format mid-stream
+            ma_uint32 entrySize = movBe32(p + 8);
+            if (entrySize >= 8 && entrySize <= bytes - 8) {
+                track.codec.assign((const char*)p + 12, 4);
+                movParseSampleEntry(p + 16, entrySize - 8, track);
+            }
+        } else if (!strcmp(type, "stsc") && bytes >= 8) {
+            ma_uint32 count = std::min<ma_uint32>(movBe32(p + 4), (ma_uint32)((bytes - 8) / 12));
+            for (ma_uint32 i = 0; i < count; i++) {
+                track.stsc.push_back(movBe32(p + 8 + i * 12));
+                track.stsc.push_back(movBe32(p + 12 + i * 12));
+            }
+        } else if (!strcmp(type, "stsz") && bytes >= 12) {
+            track.sampleSize = movBe32(p + 4);
+            track.sampleCount = movBe32(p + 8);
+        } else if ((!strcmp(type, "stco") || !strcmp(type, "co64")) && bytes >= 8) {
+            bool wide = type[0] == 'c';
+            size_t entry = wide ? 8 : 4;
+            ma_uint32 count = std::min<ma_uint32>(movBe32(p + 4), (ma_uint32)((bytes - 8) / entry));
+            track.chunkOffsets.resize(count);
+            for (ma_uint32 i = 0; i < count; i++) {
+                track.chunkOffsets[i] = wide ? movBe64(p + 8 + i * entry) : movBe32(p + 8 + i * entry);
+            }
+        }
+    });
+}
+
+// Stored sample layout for a codec, false if it isn't uncompressed PCM we can play
+static bool movPcmLayout(MovTrack& track, ma_format& format, bool& signedBytes)
+{
+    const std::string& codec = track.codec;
+    signedBytes = false;
+    
+    if (codec == "sowt" || codec == "twos") {
+        track.bigEndian = codec == "twos";
+        track.isFloat = false;
+        if (track.bitsPerSample != 8 && track.bitsPerSample != 16) track.bitsPerSample = 16;
+        signedBytes = track.bitsPerSample == 8;
+    } else if (codec == "in24" || codec == "in32" || codec == "fl32") {
+        if (!track.bigEndianKnown) track.bigEndian = true;
+        track.bitsPerSample = codec == "in24" ? 24 : 32;
+        track.isFloat = codec == "fl32";
+    } else if (codec != "lpcm") {
+        return false;
+    }
+    
+    if (!track.interleaved) return false;
+    if (track.isFloat) {
+        format = track.bitsPerSample == 32 ? ma_format_f32 : ma_format_unknown;
+    } else {
+        switch (track.bitsPerSample) {
+            case 8:  format = ma_format_u8; signedBytes = signedBytes || (codec == "lpcm" && track.signedInt); break;
+            case 16: format = ma_format_s16; break;
+            case 24: format = ma_format_s24; break;
+            case 32: format = ma_format_s32; break;
+            default: format = ma_format_unknown; break;
+        }
+    }
+    return format != ma_format_unknown;
+}
+
+static bool movOpen(const char* fileName, MovPcmSource& source)
+{
+    source.file.open(fileName, std::ios::binary);
+    if (!source.file) return false;
+    
+    std::error_code ec;
+    ma_uint64 fileSize = (ma_uint64)fs::file_size(fs::path(fileName), ec);
+    if (ec) return false;
+    
+    // Top-level boxes - moov may sit before or after mdat
+    std::vector<std::uint8_t> moov;
+    for (ma_uint64 pos = 0; pos + 8 <= fileSize; ) {
+        std::uint8_t header[16];
+        source.file.seekg((std::streamoff)pos);
+        if (!source.file.read((char*)header, 8)) return false;
+        
+        ma_uint64 boxSize = movBe32(header);
+        ma_uint64 headerSize = 8;
+        if (boxSize == 1) {
+            if (!source.file.read((char*)header + 8, 8)) return false;
+            boxSize = movBe64(header + 8);
+            headerSize = 16;
+        } else if (boxSize == 0) {
+            boxSize = fileSize - pos;
+        }
+        if (boxSize < headerSize || boxSize > fileSize - pos) return false;
+        
+        if (memcmp(header + 4, "moov", 4) == 0) {
+            if (boxSize - headerSize > MOV_MAX_MOOV_BYTES) return false;
+            moov.resize((size_t)(boxSize - headerSize));
+            if (!source.file.read((char*)moov.data(), (std::streamsize)moov.size())) return false;
+            break;
+        }
+        if (pos == 0 && memcmp(header + 4, "ftyp", 4) != 0 && memcmp(header + 4, "wide", 4) != 0 &&
+            memcmp(header + 4, "free", 4) != 0 && memcmp(header + 4, "mdat", 4) != 0 && memcmp(header + 4, "skip", 4) != 0) {
+            return false;                       // not an ISO-BMFF/QuickTime file
+        }
+        pos += boxSize;
+    }
+    if (moov.empty()) return false;
+    
+    // First sound track with a layout we can play
+    MovTrack track;
+    std::string otherCodecs;
+    ma_format format = ma_format_unknown;
+    bool found = false;
+    movForEachBox(moov.data(), moov.size(), [&](const char* type, const std::uint8_t* p, size_t bytes) {
+        if (found || strcmp(type, "trak") != 0) return;
+        MovTrack candidate;
+        movParseTrak(p, bytes, candidate);
+        if (!candidate.sound) return;
+        
+        bool signedBytes;
+        if (movPcmLayout(candidate, format, signedBytes) && candidate.channels > 0 && !candidate.chunkOffsets.empty()) {
+            source.signedBytes = signedBytes;
+            track = candidate;
+            found = true;
+        } else {
+            otherCodecs += (otherCodecs.empty() ? "" : ", ") + candidate.codec;
+        }
+    });
+    if (!found) {
+        if (!otherCodecs.empty()) {
+            std::cerr << "AudioHandler: " << fileName << " has no uncompressed PCM audio (" << otherCodecs << ")" << std::endl;
+        }
+        return false;
+    }
+    
+    // Rates above 65535 Hz don't fit the 16.16 field of older descriptions - the media timescale has them
+    if (track.timescale > 65535 && track.sampleRate < track.timescale) track.sampleRate = track.timescale;
+    if (track.sampleRate == 0) track.sampleRate = track.timescale;
+    if (track.sampleRate == 0) return false;
+    
+    source.format = format;
+    source.channels = track.channels;
+    source.sampleRate = track.sampleRate;
+    source.bytesPerSample = track.bitsPerSample / 8;
+    source.bigEndian = track.bigEndian && source.bytesPerSample > 1;
+    
+    // Chunk table: stsc runs give samples per chunk; a PCM sample is framesPerSample frames
+    ma_uint64 frameLimit = track.sampleCount > 0 ? track.sampleCount * track.framesPerSample : (ma_uint64)-1;
+    ma_uint64 frame = 0;
+    size_t chunkCount = track.chunkOffsets.size();
+    source.chunks.reserve(chunkCount);
+    for (size_t run = 0; run + 1 < track.stsc.size() && frame < frameLimit; run += 2) {
+        size_t first = std::max<ma_uint32>(1, track.stsc[run]) - 1;
+        size_t end = run + 3 < track.stsc.size() ? std::min<size_t>(chunkCount, track.stsc[run + 2] - 1) : chunkCount;
+        ma_uint64 framesPerChunk = (ma_uint64)track.stsc[run + 1] * track.framesPerSample;
+        
+        for (size_t c = first; c < end && frame < frameLimit; c++) {
+            ma_uint64 frames = std::min(framesPerChunk, frameLimit - frame);
+            source.chunks.push_back({ track.chunkOffsets[c], frame, frames });
+            frame += frames;
+        }
+    }
+    source.totalFrames = frame;
+    return source.totalFrames > 0;
+}
+
+static ma_result movPcmRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead)
+{
+    MovPcmSource* source = (MovPcmSource*)pDataSource;
+    ma_uint32 bytesPerFrame = source->bytesPerSample * source->channels;
+    std::uint8_t* out = (std::uint8_t*)pFramesOut;
+    ma_uint64 done = 0;
+    
+    while (done < frameCount && source->cursor < source->totalFrames) {
+        // Usually the same chunk as last time or the next one
+        const std::vector<MovChunk>& chunks = source->chunks;
+        if (source->chunk >= chunks.size() || source->cursor < chunks[source->chunk].firstFrame ||
+            source->cursor >= chunks[source->chunk].firstFrame + chunks[source->chunk].frames) {
+            auto it = std::upper_bound(chunks.begin(), chunks.end(), source->cursor,
+                [](ma_uint64 frame, const MovChunk& chunk) { return frame < chunk.firstFrame; });
+            source->chunk = (size_t)(it - chunks.begin()) - 1;
+        }
+        const MovChunk& chunk = chunks[source->chunk];
+        ma_uint64 offset = source->cursor - chunk.firstFrame;
+        ma_uint64 n = std::min(frameCount - done, chunk.frames - offset);
+        
+        source->file.clear();
+        source->file.seekg((std::streamoff)(chunk.offset + offset * bytesPerFrame));
+        source->file.read((char*)out + done * bytesPerFrame, (std::streamsize)(n * bytesPerFrame));
+        ma_uint64 got = (ma_uint64)source->file.gcount() / bytesPerFrame;
+        
+        done += got;
+        source->cursor += got;
+        if (got < n) break;                     // file cut short
+    }
+    
+    // Fix up in place to miniaudio's little-endian (and unsigned 8-bit) layout
+    size_t bytes = (size_t)(done * bytesPerFrame);
+    if (source->bigEndian) {
+        ma_uint32 width = source->bytesPerSample;
+        for (size_t i = 0; i < bytes; i += width) std::reverse(out + i, out + i + width);
+    }
+    if (source->signedBytes) {
+        for (size_t i = 0; i < bytes; i++) out[i] ^= 0x80;
+    }
+    
+    if (pFramesRead) *pFramesRead = done;
+    return (done < frameCount || done == 0) ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result movPcmSeek(ma_data_source* pDataSource, ma_uint64 frameIndex)
+{
+    MovPcmSource* source = (MovPcmSource*)pDataSource;
+    if (frameIndex > source->totalFrames) return MA_INVALID_ARGS;
+    source->cursor = frameIndex;
+    return MA_SUCCESS;
+}
+
+static ma_result movPcmGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels,
+                                     ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap)
+{
+    MovPcmSource* source = (MovPcmSource*)pDataSource;
+    if (pFormat) *pFormat = source->format;
+    if (pChannels) *pChannels = source->channels;
+    if (pSampleRate) *pSampleRate = source->sampleRate;
+    if (pChannelMap) ma_channel_map_init_standard(ma_standard_channel_map_default, pChannelMap, channelMapCap, source->channels);
+    return MA_SUCCESS;
+}
+
+static ma_result movPcmGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor)
+{
+    *pCursor = ((MovPcmSource*)pDataSource)->cursor;
+    return MA_SUCCESS;
+}
+
+static ma_result movPcmGetLength(ma_data_source* pDataSource, ma_uint64* pLength)
+{
+    *pLength = ((MovPcmSource*)pDataSource)->totalFrames;
+    return MA_SUCCESS;
+}
+
+static ma_data_source_vtable g_movPcmVtable = {
+    movPcmRead,
+    movPcmSeek,
+    movPcmGetDataFormat,
+    movPcmGetCursor,
+    movPcmGetLength,
+    nullptr,
+    0
+};
+
+static ma_result movBackendInitFile(void* pUserData, const char* pFilePath, const ma_decoding_backend_config* pConfig,
+                                    const ma_allocation_callbacks* pAllocationCallbacks, ma_data_source** ppBackend)
+{
+    (void)pUserData;
+    (void)pConfig;
+    (void)pAllocationCallbacks;
+    
+    // Other formats go to miniaudio's own decoders without being opened here
+    std::string ext = fileExtension(pFilePath);
+    if (ext != "mov" && ext != "mp4" && ext != "m4a" && ext != "m4v" && ext != "qt") return MA_INVALID_FILE;
+    
+    MovPcmSource* source = new MovPcmSource();
+    if (!movOpen(pFilePath, *source)) {
+        delete source;
+        return MA_INVALID_FILE;
+    }
+    
+    ma_data_source_config dsConfig = ma_data_source_config_init();
+    dsConfig.vtable = &g_movPcmVtable;
+    ma_data_source_init(&dsConfig, &source->base);
+    *ppBackend = &source->base;
+    return MA_SUCCESS;
+}
+
+static void movBackendUninit(void* pUserData, ma_data_source* pBackend, const ma_allocation_callbacks* pAllocationCallbacks)
+{
+    (void)pUserData;
+    (void)pAllocationCallbacks;
+    MovPcmSource* source = (MovPcmSource*)pBackend;
+    ma_data_source_uninit(&source->base);
+    delete source;
+}
+
+static ma_decoding_backend_vtable g_movPcmBackend = {
+    nullptr,                    // file path only - no stream/VFS init
+    movBackendInitFile,
+    nullptr,
+    nullptr,
+    movBackendUninit
+};
+
+static ma_decoding_backend_vtable* g_customBackends[] = { &g_movPcmBackend };
+
+// Every decoder in this file goes through here, so containers work wherever files are opened
+static ma_decoder_config decoderConfig(ma_format format, ma_uint32 channels, ma_uint32 sampleRate)
+{
+    ma_decoder_config cfg = ma_decoder_config_init(format, channels, sampleRate);
+    cfg.ppCustomBackendVTables = g_customBackends;
+    cfg.customBackendCount = sizeof(g_customBackends) / sizeof(g_customBackends[0]);
+    return cfg;
+}
+
+// ============================================================================
+// Broadcast WAV timecode
+// bext holds the start of the recording as samples since midnight; iXML adds the
+// production frame rate and drop-frame flag. Only chunk headers and these two
+// chunks are read - the data chunk is stepped over by its size.
+// ============================================================================
+static const ma_uint32 BEXT_TIME_REFERENCE = 338;       // offset of TimeReference in the bext payload
+static const ma_uint64 IXML_MAX_BYTES = 1024 * 1024;
+static const double SECONDS_PER_DAY = 86400.0;
+
+static ma_uint32 le32(const std::uint8_t* p) { return (ma_uint32)p[0] | ((ma_uint32)p[1] << 8) | ((ma_uint32)p[2] << 16) | ((ma_uint32)p[3] << 24); }
+static ma_uint64 le64(const std::uint8_t* p) { return (ma_uint64)le32(p) | ((ma_uint64)le32(p + 4) << 32); }
+
+// Text of the first <tag>...</tag>, trimmed - empty if the tag isn't there
+static std::string ixmlValue(const std::string& xml, const char* tag)
+{
+    std::string open = std::string("<") + tag + ">";
+    size_t start = xml.find(open);
+    if (start == std::string::npos) return std::string();
+    start += open.size();
+    size_t end = xml.find('<', start);
+    if (end == std::string::npos) return std::string();
+    
+    std::string value = xml.substr(start, end - start);
+    size_t first = value.find_first_not_of(" \t\r\n");
+    size_t last = value.find_last_not_of(" \t\r\n");
+    return first == std::string::npos ? std::string() : value.substr(first, last - first + 1);
+}
+
+// HH:MM:SS:FF at a nominal rate, ';' before the frames for drop-frame
+static std::string formatTimecode(ma_uint64 frames, int nominalFps, bool dropFrame)
+{
+    if (dropFrame && nominalFps % 30 == 0) {
+        // Inverse of parseSequenceTime - put back the frame numbers skipped at minute starts
+        ma_uint64 dropped = nominalFps / 15;
+        ma_uint64 perMinute = nominalFps * 60 - dropped;
+        ma_uint64 perTenMinutes = perMinute * 10 + dropped;
+        ma_uint64 tens = frames / perTenMinutes;
+        ma_uint64 rest = frames % perTenMinutes;
+        frames += dropped * 9 * tens;
+        if (rest > dropped) frames += dropped * ((rest - dropped) / perMinute);
+    }
+    
+    ma_uint64 ff = frames % nominalFps;
+    ma_uint64 seconds = frames / nominalFps;
+    char text[32];
+    snprintf(text, sizeof(text), "%02u:%02u:%02u%c%02u", (unsigned)(seconds / 3600 % 24), (unsigned)(seconds / 60 % 60),
+             (unsigned)(seconds % 60), dropFrame ? ';' : ':', (unsigned)ff);
+    return text;
+}
+
+bool AudioHandler::readTimecode(const char* fileName, Timecode& timecode)
+{
+    timecode = Timecode();
+    
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) return false;
+    
+    std::uint8_t header[12];
+    if (!file.read((char*)header, 12) || memcmp(header + 8, "WAVE", 4) != 0) return false;
+    bool rf64 = memcmp(header, "RF64", 4) == 0 || memcmp(header, "BW64", 4) == 0;
+    if (!rf64 && memcmp(header, "RIFF", 4) != 0) return false;
+    
+    ma_uint64 dataSize64 = 0;       // RF64 keeps the real data size in ds64
+    ma_uint32 sampleRate = 0;
+    bool haveReference = false;
+    ma_uint64 reference = 0;
+    std::string ixml;
+    
+    std::uint8_t chunk[8];
+    while (file.read((char*)chunk, 8)) {
+        ma_uint64 size = le32(chunk + 4);
+        std::streamoff payload = (std::streamoff)file.tellg();
+        
+        if (memcmp(chunk, "ds64", 4) == 0 && size >= 16) {
+            std::uint8_t ds64[16];
+            if (!file.read((char*)ds64, 16)) break;
+            dataSize64 = le64(ds64 + 8);
+        } else if (memcmp(chunk, "fmt ", 4) == 0 && size >= 8) {
+            std::uint8_t fmt[8];
+            if (!file.read((char*)fmt, 8)) break;
+            sampleRate = le32(fmt + 4);
+        } else if (memcmp(chunk, "bext", 4) == 0 && size >= BEXT_TIME_REFERENCE + 8) {
+            std::uint8_t time[8];
+            file.seekg(payload + BEXT_TIME_REFERENCE);
+            if (!file.read((char*)time, 8)) break;
+            reference = le64(time);
+            haveReference = true;
+        } else if (memcmp(chunk, "iXML", 4) == 0 && size <= IXML_MAX_BYTES) {
+            ixml.resize((size_t)size);
+            if (!file.read(&ixml[0], (std::streamsize)size)) break;
+        } else if (memcmp(chunk, "data", 4) == 0 && rf64 && size == 0xFFFFFFFF) {
+            size = dataSize64;
+        }
+        
+        // Chunks are word aligned
+        file.clear();
+        file.seekg(payload + (std::streamoff)(size + (size & 1)));
+    }
+    
+    if (sampleRate == 0) return false;
+    timecode.sampleRate = sampleRate;
+    
+    if (!ixml.empty()) {
+        // TIMECODE_RATE is a ratio like 24000/1001, or a plain number
+        std::istringstream rate(ixmlValue(ixml, "TIMECODE_RATE"));
+        ma_uint32 num = 0, den = 1;
+        char slash = 0;
+        if (rate >> num) {
+            if (rate >> slash >> den && slash != '/') den = 1;
+            if (num > 0 && den > 0) {
+                ma_uint32 divisor = std::gcd(num, den);
+                timecode.fpsNum = num / divisor;
+                timecode.fpsDen = den / divisor;
+            }
+        }
+        timecode.dropFrame = ixmlValue(ixml, "TIMECODE_FLAG") == "DF";
+        
+        // Some recorders leave bext empty and only fill the iXML timestamp
+        std::string hi = ixmlValue(ixml, "TIMESTAMP_SAMPLES_SINCE_MIDNIGHT_HI");
+        std::string lo = ixmlValue(ixml, "TIMESTAMP_SAMPLES_SINCE_MIDNIGHT_LO");
+        if (!haveReference && !lo.empty()) {
+            reference = (std::strtoull(hi.c_str(), nullptr, 10) << 32) | std::strtoull(lo.c_str(), nullptr, 10);
+            ma_uint32 stampRate = (ma_uint32)std::strtoul(ixmlValue(ixml, "TIMESTAMP_SAMPLE_RATE").c_str(), nullptr, 10);
+            if (stampRate > 0 && stampRate != sampleRate) {
+                reference = (ma_uint64)((double)reference * sampleRate / stampRate + 0.5);
+            }
+            haveReference = true;
+        }
+    }
+    
+    timecode.samplesSinceMidnight = reference;
+    timecode.valid = haveReference;
+    return haveReference;
+}
+
+// ============================================================================
+// Lossless block codec for integer PCM
+// Per block and channel: fixed polynomial predictor (order 0-2) picked by the
+// smallest residual sum, residuals zigzagged and Rice coded. Blocks that don't
+// shrink are stored raw. Every block decodes on its own.
+// ============================================================================
+static const ma_uint32 PCM_BLOCK_FRAMES = 4096;
+static const ma_uint32 PEAKS_ONLY_FRAMES = 512;     // finer than a block, so short files still draw sharp
+static const size_t BLOCK_CACHE_SIZE = 32;         // compressed: just the scrub neighbourhood
+static const size_t LAZY_BLOCK_CACHE_BYTES = 32 * 1024 * 1024;  // lazy: ~3 min of 48 kHz stereo 16-bit stays resident
+static const size_t LOAD_QUEUE_SIZE = 16;          // missed blocks waiting for the loader
+static const ma_uint32 RICE_ESCAPE = 24;
+
+// Parallel decode: frames decoded and dropped before each chunk so decoder state
+// (MP3 bit reservoir and overlap) is settled at the boundary
+static const ma_uint64 PARALLEL_PREROLL_FRAMES = 4096;
+static const ma_uint32 PARALLEL_MIN_CHUNK_SECONDS = 10;
+static const ma_uint32 PARALLEL_SEEK_POINTS = 1024;        // MP3 seek table shared by the chunks
+
+enum { BLOCK_CODED = 0, BLOCK_RAW = 1 };
+
+struct BitWriter
+{
+    std::vector<std::uint8_t>& out;
+    ma_uint64 acc;
+    int bits;
+    
+    explicit BitWriter(std::vector<std::uint8_t>& o) : out(o), acc(0), bits(0) {}
+    
+    // count <= 32
+    void put(ma_uint64 value, int count)
+    {
+        acc = (acc << count) | (value & ((1ull << count) - 1));
+        bits += count;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back((std::uint8_t)(acc >> bits));
+        }
+        acc &= (1ull << bits) - 1;
+    }
+    
+    void flush()
+    {
+        if (bits > 0) out.push_back((std::uint8_t)(acc << (8 - bits)));
+        acc = 0;
+        bits = 0;
+    }
+};
+
+struct BitReader
+{
+    const std::uint8_t* data;
+    size_t size;
+    size_t pos;
+    ma_uint64 acc;
+    int bits;
+    
+    BitReader(const std::uint8_t* d, size_t n) : data(d), size(n), pos(0), acc(0), bits(0) {}
+    
+    // count <= 32
+    ma_uint64 get(int count)
+    {
+        while (bits < count) {
+            acc = (acc << 8) | (pos < size ? data[pos] : 0);
+            pos++;
+            bits += 8;
+        }
+        bits -= count;
+        ma_uint64 value = (acc >> bits) & ((1ull << count) - 1);
+        acc &= (1ull << bits) - 1;
+        return value;
+    }
+};
+
+static inline ma_int64 readSampleInt(const std::uint8_t* p, ma_uint32 bps)
+{
+    switch (bps) {
+        case 1: return (ma_int64)p[0] - 128;
+        case 2: return (ma_int16)(p[0] | (p[1] << 8));
+        case 3: return (ma_int32)(((ma_uint32)p[0] << 8) | ((ma_uint32)p[1] << 16) | ((ma_uint32)p[2] << 24)) >> 8;
+        default: return (ma_int32)((ma_uint32)p[0] | ((ma_uint32)p[1] << 8) | ((ma_uint32)p[2] << 16) | ((ma_uint32)p[3] << 24));
+    }
+}
+
+static inline void writeSampleInt(std::uint8_t* p, ma_uint32 bps, ma_int64 v)
+{
+    if (bps == 1) {
+        p[0] = (std::uint8_t)(v + 128);
+        return;
+    }
+    for (ma_uint32 b = 0; b < bps; b++) {
+        p[b] = (std::uint8_t)((ma_uint64)v >> (b * 8));
+    }
+}
+
+static inline ma_int64 predictResidual(const ma_int64* x, ma_uint32 i, ma_uint32 order)
+{
+    switch (std::min(order, i)) {
+        case 0: return x[i];
+        case 1: return x[i] - x[i - 1];
+        default: return x[i] - 2 * x[i - 1] + x[i - 2];
+    }
+}
+
+static inline ma_uint64 zigzag(ma_int64 v) { return ((ma_uint64)v << 1) ^ (ma_uint64)(v >> 63); }
+static inline ma_int64 unzigzag(ma_uint64 u) { return (ma_int64)(u >> 1) ^ -(ma_int64)(u & 1); }
+
+static void encodeBlock(const std::uint8_t* pcm, ma_uint32 frames, ma_uint32 channels, ma_uint32 bps,
+                        std::vector<std::uint8_t>& out)
+{
+    size_t rawSize = (size_t)frames * channels * bps;
+    
+    out.clear();
+    out.push_back(BLOCK_CODED);
+    BitWriter writer(out);
+    std::vector<ma_int64> x(frames);
+    
+    for (ma_uint32 c = 0; c < channels; c++) {
+        for (ma_uint32 i = 0; i < frames; i++) {
+            x[i] = readSampleInt(pcm + ((size_t)i * channels + c) * bps, bps);
+        }
+        
+        ma_uint64 sums[3] = { 0, 0, 0 };
+        for (ma_uint32 i = 0; i < frames; i++) {
+            for (ma_uint32 o = 0; o < 3; o++) sums[o] += zigzag(predictResidual(x.data(), i, o));
+        }
+        ma_uint32 order = 0;
+        for (ma_uint32 o = 1; o < 3; o++) {
+            if (sums[o] < sums[order]) order = o;
+        }
+        
+        // Rice parameter ~ log2 of the mean residual
+        ma_uint32 k = 0;
+        while (k < 31 && ((ma_uint64)frames << (k + 1)) <= sums[order]) k++;
+        
+        writer.put(order, 2);
+        writer.put(k, 5);
+        
+        for (ma_uint32 i = 0; i < frames; i++) {
+            ma_uint64 u = zigzag(predictResidual(x.data(), i, order));
+            ma_uint64 q = u >> k;
+            if (q < RICE_ESCAPE) {
+                writer.put(1, (int)q + 1);
+                writer.put(u, (int)k);
+            } else {
+                writer.put(0, RICE_ESCAPE);
+                writer.put(u >> 32, 32);
+                writer.put(u, 32);
+            }
+        }
+    }
+    writer.flush();
+    
+    if (out.size() > rawSize) {
+        out.assign(1, BLOCK_RAW);
+        out.insert(out.end(), pcm, pcm + rawSize);
+    }
+}
+
+static void decodeBlock(const std::uint8_t* in, size_t size, std::uint8_t* pcm,
+                        ma_uint32 frames, ma_uint32 channels, ma_uint32 bps)
+{
+    if (in[0] == BLOCK_RAW) {
+        memcpy(pcm, in + 1, (size_t)frames * channels * bps);
+        return;
+    }
+    
+    BitReader reader(in + 1, size - 1);
+    
+    for (ma_uint32 c = 0; c < channels; c++) {
+        ma_uint32 order = (ma_uint32)reader.get(2);
+        int k = (int)reader.get(5);
+        ma_int64 prev1 = 0, prev2 = 0;
+        
+        for (ma_uint32 i = 0; i < frames; i++) {
+            ma_uint64 q = 0;
+            while (q < RICE_ESCAPE && reader.get(1) == 0) q++;
+            
+            ma_uint64 u;
+            if (q == RICE_ESCAPE) {
+                u = reader.get(32) << 32;
+                u |= reader.get(32);
+            } else {
+                u = (q << k) | reader.get(k);
+            }
+            
+            ma_int64 residual = unzigzag(u);
+            ma_int64 v;
+            switch (std::min(order, i)) {
+                case 0: v = residual; break;
+                case 1: v = residual + prev1; break;
+                default: v = residual + 2 * prev1 - prev2; break;
+            }
+            
+            writeSampleInt(pcm + ((size_t)i * channels + c) * bps, bps, v);
+            prev2 = prev1;
+            prev1 = v;
+        }
+    }
+}
+
+// ============================================================================
+// Sync estimation
+// Both recordings are cut down to a 1 kHz loudness envelope, differentiated so
+// claps and consonants stand out over level and mic differences, and all lags
+// are scored at once with an FFT cross-correlation.
+// ============================================================================
+static const ma_uint32 SYNC_ENVELOPE_RATE = 1000;
+static const double SYNC_MAX_SECONDS = 600.0;      // compare at most the first 10 minutes of each
+
+typedef std::complex<double> Complex;
+
+// First sample of an envelope bin
+static inline ma_uint64 syncBinStart(size_t bin, ma_uint32 sampleRate)
+{
+    return (ma_uint64)bin * sampleRate / SYNC_ENVELOPE_RATE;
+}
+
+// Per-bin sums of |sample| to onset strength: mean level in log terms, then the rise
+// from the previous bin, with the mean taken out so silence doesn't correlate
+static std::vector<float> syncOnsets(const std::vector<double>& sums, ma_uint32 sampleRate)
+{
+    std::vector<float> onsets(sums.size());
+    float previous = 0.0f;
+    double total = 0.0;
+    
+    for (size_t bin = 0; bin < sums.size(); bin++) {
+        ma_uint64 count = std::max<ma_uint64>(1, syncBinStart(bin + 1, sampleRate) - syncBinStart(bin, sampleRate));
+        float level = std::log(1e-3f + (float)(sums[bin] / count));
+        float rise = bin > 0 ? std::max(0.0f, level - previous) : 0.0f;
+        previous = level;
+        onsets[bin] = rise;
+        total += rise;
+    }
+    
+    float mean = onsets.empty() ? 0.0f : (float)(total / onsets.size());
+    for (float& onset : onsets) onset -= mean;
+    return onsets;
+}
+
+static bool syncReferenceOnsets(const char* fileName, std::vector<float>& onsets)
+{
+    // Mono at the native rate - the decoder does the downmix
+    ma_decoder decoder;
+    ma_decoder_config cfg = decoderConfig(ma_format_f32, 1, 0);
+    if (ma_decoder_init_file(fileName, &cfg, &decoder) != MA_SUCCESS) return false;
+    
+    ma_uint32 sampleRate = decoder.outputSampleRate;
+    ma_uint64 maxFrames = (ma_uint64)(SYNC_MAX_SECONDS * sampleRate);
+    std::vector<double> sums;
+    std::vector<float> chunk(65536);
+    ma_uint64 position = 0;
+    size_t bin = 0;
+    ma_uint64 binEnd = syncBinStart(1, sampleRate);
+    
+    while (position < maxFrames) {
+        ma_uint64 framesRead = 0;
+        ma_decoder_read_pcm_frames(&decoder, chunk.data(), std::min<ma_uint64>(chunk.size(), maxFrames - position), &framesRead);
+        if (framesRead == 0) break;
+        
+        for (ma_uint64 i = 0; i < framesRead; i++, position++) {
+            while (position >= binEnd) binEnd = syncBinStart(++bin + 1, sampleRate);
+            if (bin >= sums.size()) sums.resize(bin + 1, 0.0);
+            sums[bin] += std::fabs(chunk[i]);
+        }
+    }
+    ma_decoder_uninit(&decoder);
+    
+    onsets = syncOnsets(sums, sampleRate);
+    return !onsets.empty();
+}
+
+// In-place radix-2 FFT - size must be a power of two
+static void fft(std::vector<Complex>& a, bool inverse)
+{
+    const size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(a[i], a[j]);
+    }
+    
+    const double twoPi = 6.283185307179586;
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double angle = (inverse ? twoPi : -twoPi) / len;
+        for (size_t k = 0; k < len / 2; k++) {
+            // Twiddle per k rather than by repeated multiplication - stays exact at 2^20+ points
+            Complex w(std::cos(angle * k), std::sin(angle * k));
+            for (size_t i = k; i < n; i += len) {
+                Complex u = a[i];
+                Complex v = a[i + len / 2] * w;
+                a[i] = u + v;
+                a[i + len / 2] = u - v;
+            }
+        }
+    }
+    
+    if (inverse) {
+        for (Complex& x : a) x /= (double)n;
+    }
+}
+
+// Lag in bins at which b best matches a (a[n + lag] ~ b[n]), refined between bins.
+// score is the peak over the two signals' energies, 0..1.
+static double syncCorrelate(const std::vector<float>& a, const std::vector<float>& b, float& score)
+{
+    size_t n = 1;
+    while (n < a.size() + b.size()) n <<= 1;
+    
+    std::vector<Complex> fa(n), fb(n);
+    for (size_t i = 0; i < a.size(); i++) fa[i] = a[i];
+    for (size_t i = 0; i < b.size(); i++) fb[i] = b[i];
+    
+    // The two forward transforms are independent
+    std::thread other([&fa]() { fft(fa, false); });
+    fft(fb, false);
+    other.join();
+    
+    for (size_t i = 0; i < n; i++) fa[i] *= std::conj(fb[i]);
+    fft(fa, true);
+    
+    // Lags from -(b - 1) to a - 1; negative lags wrap to the end
+    auto at = [&](long long lag) { return fa[(size_t)(lag < 0 ? lag + (long long)n : lag)].real(); };
+    long long best = 0;
+    double peak = -1e300;
+    for (long long lag = -(long long)b.size() + 1; lag < (long long)a.size(); lag++) {
+        double c = at(lag);
+        if (c > peak) {
+            peak = c;
+            best = lag;
+        }
+    }
+    
+    double energyA = 0.0, energyB = 0.0;
+    for (float x : a) energyA += (double)x * x;
+    for (float x : b) energyB += (double)x * x;
+    score = energyA > 0.0 && energyB > 0.0 ? (float)std::max(0.0, peak / std::sqrt(energyA * energyB)) : 0.0f;
+    
+    // Parabola through the peak and its neighbours
+    double y0 = at(best - 1), y1 = peak, y2 = at(best + 1);
+    double curve = y0 - 2.0 * y1 + y2;
+    double shift = curve < 0.0 ? 0.5 * (y0 - y2) / curve : 0.0;
+    return best + std::max(-0.5, std::min(0.5, shift));
+}
+
+AudioHandler::AudioHandler(DeviceMode deviceMode)
+    : _deviceMode(deviceMode)
+    , _context(nullptr)
+    , _engine(nullptr)
     , _sound(nullptr)
     , _decoder(nullptr)
+    , _source(nullptr)
     , _initialized(false)
+    , _initFailed(false)
     , _fileLoaded(false)
     , _lastPlayedFrame(-9999)
+    , _soloChannel(-1)
+    , _fileSize(0)
+    , _fileTime(0)
+    , _fileHash(0)
+    , _loadedCompress(false)
+    , _engineSampleRate(48000)
     , _sampleRate(48000)
     , _channels(2)
     , _totalPcmFrames(0)
     , _fps(25.0f)
-    , waveformDataL(nullptr)
-    , waveformDataR(nullptr)
+    , _fpsNum(25)
+    , _fpsDen(1)
+    , _lengthInFrames(0)
+    , _subFrameOffsetSamples(0)
+    , _subFrameOffsetMs(0.0)
+    , _subFrameOffsetInMs(false)
     , waveformWidth(0)
+    , _mapped(nullptr)
+    , _pcm(nullptr)
+    , _sampleFormat(0)
+    , _bytesPerFrame(0)
+    , _compressPcm(false)
+    , _compressed(false)
+    , _blockCacheCapacity(BLOCK_CACHE_SIZE)
+    , _blockClock(0)
+    , _loadStop(false)
+    , _lazyDecode(false)
+    , _lazy(false)
+    , _peaksOnlyLoad(false)
+    , _peaksOnly(false)
+    , _peaksChanged(false)
+    , _featureFrames(0)
+    , _statLoadMs(0.0)
+    , _statDecodedBytes(0)
+    , _statPcmBytes(0)
+    , _statWaveformBytes(0)
+    , _statPlayCalls(0)
+    , _statSkipped(0)
+    , _statCoalesced(0)
+    , _statLockWaits(0)
+    , _statLockWaitNs(0)
+    , _statUnderruns(0)
+    , _lastCallbackNs(0)
+    , _cbPeriodFrames(0)
+    , _cbSampleRate(0)
+    , _trackCount(0)
+    , _mixPcmFrames(0)
+    , _isSequence(false)
+    , _segmentClock(0)
+    , _followFile(false)
+    , _followStatus(FOLLOW_UNCHANGED)
+    , _watch(nullptr)
+    , _periodFrames(defaultPeriodFrames())
+    , _autoTunePeriod(false)
+    , _tuneCallbacks(0)
+    , _tuneUnderruns(0)
+    , _tuneCleanWindows(0)
+    , _tuneFailedFrames(0)
+    , _tuneSettledFrames(0)
+    , _tunePendingFrames(0)
+    , _tuneStop(false)
+    , _lastPlayNs(0)
+{
+    resetStats();
+    _loadQueue.reserve(LOAD_QUEUE_SIZE);
+    for (int track = 0; track < MAX_TRACKS; track++) {
+        _trackGain[track].store(1.0f);
+        _trackMute[track].store(false);
+    }
+    
+    // No engine here - see ensureEngine()
+}
+
+AudioHandler::~AudioHandler()
+{
+    stopFollowing();
+    _tuneStop.store(true);
+    if (_tuneThread.joinable()) _tuneThread.join();
+    {
+        std::lock_guard<std::mutex> lock(_loadMutex);
+        _loadStop = true;
+    }
+    _loadWake.notify_all();
+    if (_loadThread.joinable()) _loadThread.join();
+    cleanup();
+}
+
+// The engine comes up on first use on every platform, never in the constructor:
+// the plugin's handler is a static, and opening an audio device while the library
+// is loading can freeze the host (seen on Windows). Callers hold _mutex, so only
+// one thread ever initializes. A failed init isn't retried on every load - only
+// when the device is re-created (setPeriodFrames).
+bool AudioHandler::ensureEngine()
+{
+    if (_initialized.load()) return true;
+    if (_initFailed || _deviceMode == DEVICE_OFF) return false;
+    
+    if (!initEngine()) {
+        _initFailed = true;
+        std::cerr << "AudioHandler: Audio engine unavailable - playback disabled" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool AudioHandler::initEngine()
+{
+    if (_initialized.load()) return true;
+    
+    std::cout << "AudioHandler: Initializing audio engine..." << std::endl;
+    
+    EngineHost* host = new EngineHost();
+    host->handler = this;
+    _engine = &host->engine;
+    
+    ma_engine_config config = ma_engine_config_init();
+    config.channels = 2;
+    config.sampleRate = 48000;
+    
+    // Null backend: a real device thread pulling audio, but no hardware
+    if (_deviceMode == DEVICE_NULL) {
+        ma_backend backend = ma_backend_null;
+        _context = new ma_context();
+        if (ma_context_init(&backend, 1, nullptr, _context) != MA_SUCCESS) {
+            std::cerr << "AudioHandler: Failed to init null backend" << std::endl;
+            delete _context;
+            _context = nullptr;
+            delete EngineHost::of(_engine);
+            _engine = nullptr;
+            return false;
+        }
+        config.pContext = _context;
+    }
+    // No device: the engine is only advanced by renderOutput()
+    if (_deviceMode == DEVICE_NONE) {
+        config.noDevice = MA_TRUE;
+    }
+    config.dataCallback = EngineHost::onData;
+    config.notificationCallback = EngineHost::onNotification;
+    config.periodSizeInFrames = _periodFrames.load();
+    
+    ma_result result = ma_engine_init(&config, _engine);
+    if (result != MA_SUCCESS) {
+        std::cerr << "AudioHandler: Failed to init engine, error: " << result << std::endl;
+        delete EngineHost::of(_engine);
+        _engine = nullptr;
+        return false;
+    }
+    
+    _engineSampleRate = ma_engine_get_sample_rate(_engine);
+    _lastCallbackNs.store(0);
+    _initialized.store(true);
+    std::cout << "AudioHandler: Engine ready @ " << _engineSampleRate << " Hz, "
+              << config.periodSizeInFrames << " frame buffer" << std::endl;
+    return true;
+}
+
+void AudioHandler::cleanup()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    _fileLoaded.store(false);
+    
+    releaseSound();
+    
+    if (_decoder) {
+        ma_decoder_uninit(_decoder);
+        delete _decoder;
+        _decoder = nullptr;
+    }
+    
+    releaseEngine();
+    
+    _waveform.clear();
+    waveformWidth = 0;
+    
+    clearPcm();
+    _currentFile.clear();
+    _timecode = Timecode();
+    _downmixL.clear();
+    _downmixR.clear();
+    _features.clear();
+    _featureFrames = 0;
+    updateWaveformStats();
+    _initialized.store(false);
+}
+
+bool AudioHandler::loadFile(const char* fileName, float fps)
+{
+    // The watcher appends to the store, so it can't run across a load
+    stopFollowing();
+    if (!openFile(fileName, fps)) return false;
+    
+    if (_followFile.load()) {
+        startFollowing();
+    }
+    return true;
+}
+
+bool AudioHandler::openFile(const char* fileName, float fps)
+{
+    TraceScope trace("loadFile");
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto loadStart = std::chrono::steady_clock::now();
+    
+    if (reuseLoaded(fileName, fps)) {
+        _statLoadMs.store(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+        return true;
+    }
+    
+    // Set FPS first!
+    ma_uint32 fpsNum, fpsDen;
+    rationalFps(std::max(1.0f, fps), fpsNum, fpsDen);
+    applyFps(fpsNum, fpsDen);
+    
+    // Lazy init engine on first file load
+    bool playback = _deviceMode != DEVICE_OFF;
+    if (playback && !ensureEngine()) {
+        std::cerr << "AudioHandler: Cannot load - engine init failed" << std::endl;
+        return false;
+    }
+    
+    // Cleanup previous
+    releaseSound();
+    
+    if (_decoder) {
+        ma_decoder_uninit(_decoder);
+        delete _decoder;
+        _decoder = nullptr;
+    }
+    
+    clearPcm();
+    _currentFile.clear();
+    _waveform.clear();
+    waveformWidth = 0;
+    _features.clear();
+    _featureFrames = 0;
+    _fileLoaded.store(false);
+    _lastPlayedFrame.store(-9999);
+    _statDecodedBytes.store(0);
+    
+    // Compressed sources decoded before come straight from the disk cache
+    ma_channel channelMap[MA_MAX_CHANNELS];
+    bool sequence = isSequenceList(fileName);
+    
+    // Stamped before decoding, so a write during the decode shows up as a change later
+    if (sequence || !fileStamp(fileName, _fileSize, _fileTime, _fileHash)) {
+        _fileSize = 0;
+        _fileTime = 0;
+        _fileHash = 0;
+    }
+    if (sequence || !readTimecode(fileName, _timecode)) {
+        _timecode = Timecode();
+    }
+    bool compressedSource = !sequence && isCompressedFormat(fileName);
+    bool cached = compressedSource && !peaksOnlyLoad() && loadFromDiskCache(fileName, channelMap);
+    
+    if (sequence) {
+        if (!loadSequence(fileName, channelMap)) return false;
+    } else if (!cached) {
+        if (!decodeFile(fileName, channelMap)) return false;
+        
+        if (!_lazy) {
+            _statDecodedBytes.store(_totalPcmFrames * _bytesPerFrame);
+        }
+        
+        // Only worth it where the file gets played again - not for farm renders
+        if (compressedSource && !_lazy && !_peaksOnly && playback) {
+            writeDiskCache(fileName, channelMap);
+        }
+    }
+    
+    if (_compressPcm.load() && !_lazy && !_peaksOnly && !sequence) {
+        compressPcm();
+    }
+    
+    // Stereo downmix gains per source channel (rectangular-style fold-down, LFE dropped)
+    _downmixL.assign(_channels, 0.0f);
+    _downmixR.assign(_channels, 0.0f);
+    const float minus3dB = 0.7071f;
+    
+    for (ma_uint32 c = 0; c < _channels; c++) {
+        switch (channelMap[c]) {
+            case MA_CHANNEL_MONO:
+            case MA_CHANNEL_FRONT_CENTER:
+                _downmixL[c] = minus3dB;
+                _downmixR[c] = minus3dB;
+                break;
+            case MA_CHANNEL_FRONT_LEFT:
+                _downmixL[c] = 1.0f;
+                break;
+            case MA_CHANNEL_FRONT_RIGHT:
+                _downmixR[c] = 1.0f;
+                break;
+            case MA_CHANNEL_SIDE_LEFT:
+            case MA_CHANNEL_BACK_LEFT:
+            case MA_CHANNEL_FRONT_LEFT_CENTER:
+                _downmixL[c] = minus3dB;
+                break;
+            case MA_CHANNEL_SIDE_RIGHT:
+            case MA_CHANNEL_BACK_RIGHT:
+            case MA_CHANNEL_FRONT_RIGHT_CENTER:
+                _downmixR[c] = minus3dB;
+                break;
+            case MA_CHANNEL_LFE:
+                break;
+            default:
+                _downmixL[c] = 0.5f;
+                _downmixR[c] = 0.5f;
+                break;
+        }
+    }
+    
+    // Mono plays at full level on both sides
+    if (_channels == 1) {
+        _downmixL[0] = 1.0f;
+        _downmixR[0] = 1.0f;
+    }
+    
+    if (_soloChannel.load() >= (int)_channels) {
+        _soloChannel.store(-1);
+    }
+    
+    updateTrackTiming();
+    
+    if (playback && !createSound()) {
+        std::cerr << "AudioHandler: Failed to create sound for " << fileName << std::endl;
+        return false;
+    }
+    
+    buildFrameTable();
+    
+    float duration = (float)_totalPcmFrames / _sampleRate;
+    // getFileLengthInFrames checks _fileLoaded which isn't set yet
+    int lengthInFrames = _lengthInFrames.load();
+    
+    std::cout << "AudioHandler: Loaded " << fileName << std::endl;
+    std::cout << "  " << _sampleRate << " Hz, " << _channels << " ch, " 
+              << ma_get_format_name((ma_format)_sampleFormat) << " (" << (cached ? "disk cache, " : "") << (_lazy || sequence ? "decode on demand, " : "")
+              << (_peaksOnly ? "peaks only, " : "")
+              << pcmBytes() / (1024 * 1024) << " MB" << (_compressed ? " compressed" : "") << "), "
+              << duration << "s (" << lengthInFrames << " frames @ " << _fps << " fps)"
+              << (playback ? "" : ", no playback") << std::endl;
+    if (_timecode.valid) {
+        // At the recorder's rate if iXML names one, otherwise at the timeline's
+        ma_uint32 num = _timecode.fpsNum ? _timecode.fpsNum : _fpsNum;
+        ma_uint32 den = _timecode.fpsNum ? _timecode.fpsDen : _fpsDen;
+        ma_uint64 frames = (ma_uint64)((double)_timecode.samplesSinceMidnight / _timecode.sampleRate * num / den + 0.5);
+        std::cout << "  timecode " << formatTimecode(frames, (int)std::lround((double)num / den), _timecode.dropFrame)
+                  << " @ " << (double)num / den << " fps" << (_timecode.fpsNum ? "" : " (timeline)") << std::endl;
+    }
+    
+    _currentFile = fileName;
+    _loadedCompress = _compressPcm.load();
+    _statPcmBytes.store(pcmBytes());
+    updateWaveformStats();
+    _statLoadMs.store(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+    _fileLoaded.store(true);
+    return true;
+}
+
+bool AudioHandler::reuseLoaded(const char* fileName, float fps)
+{
+    // Caller holds _mutex. Anything in doubt is a full load.
+    if (_currentFile.empty() || _currentFile != fileName || _totalPcmFrames == 0 || _isSequence) return false;
+    if (_lazyDecode.load() != _lazy || _compressPcm.load() != _loadedCompress || peaksOnlyLoad() != _peaksOnly) return false;
+    
+    ma_uint64 size, hash;
+    ma_int64 mtime;
+    if (!fileStamp(fileName, size, mtime, hash)) return false;
+    if (size != _fileSize || mtime != _fileTime || hash != _fileHash) return false;
+    
+    // The sound survives unless the file was released
+    bool playback = _deviceMode != DEVICE_OFF;
+    if (playback && !_sound && (!ensureEngine() || !createSound())) return false;
+    
+    ma_uint32 fpsNum, fpsDen;
+    rationalFps(std::max(1.0f, fps), fpsNum, fpsDen);
+    if (fpsNum != _fpsNum || fpsDen != _fpsDen) {
+        applyFps(fpsNum, fpsDen);
+        timingChanged();
+    }
+    
+    _lastPlayedFrame.store(-9999);
+    _fileLoaded.store(true);
+    std::cout << "AudioHandler: " << fileName << " unchanged - kept the decoded audio" << std::endl;
+    return true;
+}
+
+bool AudioHandler::decodeFile(const char* fileName, ma_channel* channelMap)
+{
+    // Decode once at the native sample format, channel count and rate (unknown/0 =
+    // keep source). Playback and waveform share this copy; ma_sound resamples.
+    _decoder = new ma_decoder();
+    ma_decoder_config cfg = decoderConfig(ma_format_unknown, 0, 0);
+    
+    // Lazy mode seeks all over the file - have MP3 build a seek table
+    if (_lazyDecode.load()) {
+        cfg.seekPointCount = 4096;
+    }
+    
+    if (ma_decoder_init_file(fileName, &cfg, _decoder) != MA_SUCCESS) {
+        std::cerr << "AudioHandler: Failed to load " << fileName << std::endl;
+        delete _decoder;
+        _decoder = nullptr;
+        return false;
+    }
+    
+    ma_format format;
+    if (ma_decoder_get_data_format(_decoder, &format, &_channels, &_sampleRate, channelMap, MA_MAX_CHANNELS) != MA_SUCCESS) {
+        std::cerr << "AudioHandler: No audio format for " << fileName << std::endl;
+        ma_decoder_uninit(_decoder);
+        delete _decoder;
+        _decoder = nullptr;
+        return false;
+    }
+    ma_decoder_get_length_in_pcm_frames(_decoder, &_totalPcmFrames);
+    _sampleFormat = (int)format;
+    _bytesPerFrame = ma_get_bytes_per_frame(format, _channels);
+    
+    if (peaksOnlyLoad()) {
+        // Overlay only - one pass through the file, keeping the peaks of every few hundred
+        // frames. generateWaveform spreads them over the pixels like block peaks.
+        TraceScope trace("decoder read (peaks)");
+        std::vector<std::uint8_t> pcm((size_t)PEAKS_ONLY_FRAMES * _bytesPerFrame);
+        std::vector<float> samples((size_t)PEAKS_ONLY_FRAMES * _channels);
+        ma_uint64 framesRead = 0;
+        ma_uint64 totalFrames = 0;
+        
+        do {
+            ma_decoder_read_pcm_frames(_decoder, pcm.data(), PEAKS_ONLY_FRAMES, &framesRead);
+            if (framesRead == 0) break;
+            ma_pcm_convert(samples.data(), ma_format_f32, pcm.data(), format, framesRead * _channels, ma_dither_mode_none);
+            
+            size_t base = _blockPeaks.size();
+            _blockPeaks.resize(base + _channels, 0.0f);
+            for (size_t i = 0; i < (size_t)framesRead * _channels; i++) {
+                float& peak = _blockPeaks[base + i % _channels];
+                peak = std::max(peak, std::abs(samples[i]));
+            }
+            totalFrames += framesRead;
+        } while (framesRead == PEAKS_ONLY_FRAMES);
+        
+        // Nothing reads the file again
+        ma_decoder_uninit(_decoder);
+        delete _decoder;
+        _decoder = nullptr;
+        _totalPcmFrames = totalFrames;
+        _peaksOnly = true;
+        return true;
+    }
+    
+    if (_lazyDecode.load() && _totalPcmFrames > 0) {
+        // Nothing decoded yet - blocks come in as playAtFrame touches them
+        size_t blockCount = (size_t)((_totalPcmFrames + PCM_BLOCK_FRAMES - 1) / PCM_BLOCK_FRAMES);
+        _blockPeaks.assign(blockCount * _channels, -1.0f);
+        _blockCacheCapacity = std::max(BLOCK_CACHE_SIZE, LAZY_BLOCK_CACHE_BYTES / ((size_t)PCM_BLOCK_FRAMES * _bytesPerFrame));
+        _lazy = true;
+    } else if (_totalPcmFrames > 0) {
+        _audioData.resize(_totalPcmFrames * _bytesPerFrame);
+        ma_uint64 framesRead = 0;
+        if (!decodeParallel(fileName, &framesRead)) {
+            TraceScope trace("decoder read");
+            ma_decoder_read_pcm_frames(_decoder, _audioData.data(), _totalPcmFrames, &framesRead);
+        }
+        _totalPcmFrames = framesRead;
+        _audioData.resize(framesRead * _bytesPerFrame);
+    } else {
+        // Length unknown up front (some streams) - read in chunks until the end
+        const ma_uint64 chunkFrames = 65536;
+        ma_uint64 framesRead = 0;
+        TraceScope trace("decoder read");
+        do {
+            size_t offset = _audioData.size();
+            _audioData.resize(offset + chunkFrames * _bytesPerFrame);
+            ma_decoder_read_pcm_frames(_decoder, _audioData.data() + offset, chunkFrames, &framesRead);
+            _audioData.resize(offset + framesRead * _bytesPerFrame);
+        } while (framesRead == chunkFrames);
+        _totalPcmFrames = _audioData.size() / _bytesPerFrame;
+    }
+    _audioData.shrink_to_fit();
+    _pcm = _audioData.data();
+    
+    return true;
+    
+}
+
+void AudioHandler::releaseFile()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    releaseSound();
+    
+    _fileLoaded.store(false);
+    _lastPlayedFrame.store(-9999);
+}
+
+bool AudioHandler::createSound()
+{
+    // Sound plays straight from the PCM store
+    _source = new PcmSource();
+    _source->handler = this;
+    _source->cursor = 0;
+    
+    ma_data_source_config dsConfig = ma_data_source_config_init();
+    dsConfig.vtable = &g_pcmSourceVtable;
+    ma_data_source_init(&dsConfig, &_source->base);
+    
+    _sound = new ma_sound();
+    if (ma_sound_init_from_data_source(_engine, _source, MA_SOUND_FLAG_NO_SPATIALIZATION, nullptr, _sound) != MA_SUCCESS) {
+        delete _sound;
+        _sound = nullptr;
+        releaseSound();
+        return false;
+    }
+    return true;
+}
+
+void AudioHandler::releaseEngine()
+{
+    if (_engine) {
+        ma_engine_uninit(_engine);
+        delete EngineHost::of(_engine);
+        _engine = nullptr;
+    }
+    
+    if (_context) {
+        ma_context_uninit(_context);
+        delete _context;
+        _context = nullptr;
+    }
+}
+
+// New device with the current period - caller holds _mutex. The PCM store is
+// untouched; only the sound is rebuilt on the new engine.
+bool AudioHandler::restartEngine()
+{
+    bool hadSound = _sound != nullptr;
+    
+    releaseSound();
+    releaseEngine();
+    _initialized.store(false);
+    _initFailed = false;
+    _lastPlayedFrame.store(-9999);
+    
+    if (!ensureEngine() || (hadSound && !createSound())) {
+        std::cerr << "AudioHandler: Audio device restart failed" << std::endl;
+        _fileLoaded.store(false);
+        return false;
+    }
+    return true;
+}
+
+bool AudioHandler::setDeviceMode(DeviceMode deviceMode)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (deviceMode == _deviceMode) return true;
+    if (_initialized.load()) return false;
+    
+    _deviceMode = deviceMode;
+    _initFailed = false;
+    return true;
+}
+
+bool AudioHandler::setPeriodFrames(ma_uint32 frames)
+{
+    frames = std::max(MIN_PERIOD_FRAMES, std::min(MAX_PERIOD_FRAMES, frames));
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (frames == _periodFrames.load()) return true;
+    
+    _periodFrames.store(frames);
+    
+    // Not running yet - ensureEngine picks it up
+    if (!_initialized.load()) return true;
+    return restartEngine();
+}
+
+void AudioHandler::setAutoTunePeriod(bool enabled)
+{
+    if (_autoTunePeriod.exchange(enabled) == enabled) return;
+    _tunePendingFrames.store(0);
+    
+    if (enabled) {
+        // Start where this machine settled before, or at the platform default
+        ma_uint32 saved = loadHostPeriod();
+        setPeriodFrames(saved ? std::max(saved, lowestTunedPeriod()) : defaultPeriodFrames());
+        
+        std::lock_guard<std::mutex> lock(_tuneMutex);
+        _tuneCallbacks = _cbCount.load();
+        _tuneUnderruns = _statUnderruns.load();
+        _tuneCleanWindows = 0;
+        _tuneFailedFrames = 0;
+        _tuneSettledFrames = saved;
+        _tunePendingFrames.store(0);
+    }
+}
+
+// Every AUTOTUNE_WINDOW_SECONDS of audio: enough underruns double the period, a long
+// clean run saves the size and then tries half of it
+void AudioHandler::autoTunePeriod()
+{
+    if (!_autoTunePeriod.load(std::memory_order_relaxed) || _deviceMode == DEVICE_NONE) return;
+    
+    std::unique_lock<std::mutex> lock(_tuneMutex, std::try_to_lock);
+    if (!lock.owns_lock() || _tunePendingFrames.load() != 0) return;
+    
+    ma_uint64 callbacks = _cbCount.load(std::memory_order_relaxed);
+    ma_uint64 underruns = _statUnderruns.load(std::memory_order_relaxed);
+    ma_uint64 period = std::max(1u, _cbPeriodFrames.load(std::memory_order_relaxed));
+    ma_uint64 rate = std::max(1u, _cbSampleRate.load(std::memory_order_relaxed));
+    
+    // resetStats() zeroed the counters - start a new window
+    if (callbacks < _tuneCallbacks || underruns < _tuneUnderruns) {
+        _tuneCallbacks = callbacks;
+        _tuneUnderruns = underruns;
+        return;
+    }
+    
+    if ((callbacks - _tuneCallbacks) * period < AUTOTUNE_WINDOW_SECONDS * rate) return;
+    
+    ma_uint64 windowUnderruns = underruns - _tuneUnderruns;
+    _tuneCallbacks = callbacks;
+    _tuneUnderruns = underruns;
+    
+    ma_uint32 current = _periodFrames.load();
+    ma_uint32 next = current;
+    
+    if (windowUnderruns >= AUTOTUNE_UNDERRUNS) {
+        _tuneCleanWindows = 0;
+        _tuneFailedFrames = std::max(_tuneFailedFrames, current);
+        if (current >= MAX_PERIOD_FRAMES) return;
+        
+        // A size known to hold on this host beats doubling through glitchy ones
+        next = std::min(current * 2, MAX_PERIOD_FRAMES);
+        if (_tuneSettledFrames > next) next = std::min(_tuneSettledFrames, MAX_PERIOD_FRAMES);
+        std::cout << "AudioHandler: " << windowUnderruns << " underruns in " << AUTOTUNE_WINDOW_SECONDS
+                  << "s - raising audio buffer to " << next << " frames" << std::endl;
+    } else {
+        // Any underrun restarts the clean run
+        _tuneCleanWindows = windowUnderruns == 0 ? _tuneCleanWindows + 1 : 0;
+        if (_tuneCleanWindows < AUTOTUNE_SETTLE_WINDOWS) return;
+        _tuneCleanWindows = 0;
+        
+        // Only a size that held up is remembered - a burst while Nuke was busy isn't
+        if (current != _tuneSettledFrames) {
+            _tuneSettledFrames = current;
+            saveHostPeriod(current);
+        }
+        
+        if (current / 2 < lowestTunedPeriod() || current / 2 <= _tuneFailedFrames) return;
+        next = current / 2;
+        std::cout << "AudioHandler: No underruns for " << AUTOTUNE_SETTLE_WINDOWS * AUTOTUNE_WINDOW_SECONDS
+                  << "s - lowering audio buffer to " << next << " frames" << std::endl;
+    }
+    
+    // Re-creating the device stalls for a while - not on the scrub path
+    _tunePendingFrames.store(next);
+    if (!_tuneThread.joinable()) {
+        _tuneThread = std::thread(&AudioHandler::tuneRestartLoop, this);
+    }
+}
+
+void AudioHandler::tuneRestartLoop()
+{
+    // Applies the size autoTunePeriod picked once scrubbing has paused and the last grain has run out
+    while (!_tuneStop.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (_tunePendingFrames.load() == 0 || steadyNs() - _lastPlayNs.load(std::memory_order_relaxed) < AUTOTUNE_IDLE_MS * 1000000LL) continue;
+        
+        // Auto-tune may have been switched off meanwhile
+        std::lock_guard<std::mutex> lock(_tuneMutex);
+        ma_uint32 next = _tunePendingFrames.load();
+        if (next != 0 && _autoTunePeriod.load()) setPeriodFrames(next);
+        
+        // The new device starts counting from zero intervals
+        _tuneCallbacks = _cbCount.load();
+        _tuneUnderruns = _statUnderruns.load();
+        _tunePendingFrames.store(0);
+    }
+}
+
+void AudioHandler::releaseSound()
+{
+    // Sound pulls from the source, so it goes first
+    if (_sound) {
+        ma_sound_stop(_sound);
+        ma_sound_uninit(_sound);
+        delete _sound;
+        _sound = nullptr;
+    }
+    
+    if (_source) {
+        ma_data_source_uninit(&_source->base);
+        delete _source;
+        _source = nullptr;
+    }
+}
+
+ma_uint64 AudioHandler::readMixed(ma_uint64 frame, float* out, ma_uint64 frameCount)
+{
+    // Audio thread - no locking. The store only changes once the sound is torn down.
+    if (frame >= _totalPcmFrames || _channels == 0) return 0;
+    ma_uint64 count = std::min(frameCount, _totalPcmFrames - frame);
+    
+    int solo = _soloChannel.load();
+    const float* gainL = _downmixL.data();
+    const float* gainR = _downmixR.data();
+    
+    // Convert from the stored format in stack-sized chunks
+    float in[4096];
+    ma_uint64 chunkFrames = std::max<ma_uint64>(1, 4096 / _channels);
+    
+    for (ma_uint64 done = 0; done < count; ) {
+        ma_uint64 n = std::min(chunkFrames, count - done);
+        readFloat(frame + done, in, n);
+        float* dst = out + done * 2;
+        
+        if (solo >= 0 && solo < (int)_channels) {
+            for (ma_uint64 i = 0; i < n; i++) {
+                float s = in[i * _channels + solo];
+                dst[i * 2] = s;
+                dst[i * 2 + 1] = s;
+            }
+        } else {
+            for (ma_uint64 i = 0; i < n; i++) {
+                const float* s = in + i * _channels;
+                float l = 0.0f, r = 0.0f;
+                for (ma_uint32 c = 0; c < _channels; c++) {
+                    l += s[c] * gainL[c];
+                    r += s[c] * gainR[c];
+                }
+                dst[i * 2] = l;
+                dst[i * 2 + 1] = r;
+            }
+        }
+        done += n;
+    }
+    return count;
+}
+
+void AudioHandler::readFloat(ma_uint64 frame, float* out, ma_uint64 frameCount, BlockCursor* cursor)
+{
+    if (_isSequence) {
+        readSequence(frame, out, frameCount);
+        return;
+    }
+    
+    ma_format format = (ma_format)_sampleFormat;
+    
+    if (!_compressed && !_lazy) {
+        const std::uint8_t* src = _pcm + frame * _bytesPerFrame;
+        ma_pcm_convert(out, ma_format_f32, src, format, frameCount * _channels, ma_dither_mode_none);
+        return;
+    }
+    
+    while (frameCount > 0) {
+        size_t block = (size_t)(frame / PCM_BLOCK_FRAMES);
+        ma_uint64 offset = frame % PCM_BLOCK_FRAMES;
+        ma_uint64 n = std::min<ma_uint64>(frameCount, PCM_BLOCK_FRAMES - offset);
+        
+        std::shared_ptr<std::vector<std::uint8_t>> pcm;
+        if (!cursor) {
+            // Audio thread - a block that isn't decoded yet plays as silence this callback
+            pcm = cachedBlock(block);
+            if (!pcm) {
+                requestBlock(block);
+                std::fill(out, out + n * _channels, 0.0f);
+                out += n * _channels;
+                frame += n;
+                frameCount -= n;
+                continue;
+            }
+        } else {
+            if (cursor->block != block) {
+                cursor->pcm = getBlock(block, false);
+                cursor->block = block;
+            }
+            pcm = cursor->pcm;
+        }
+        ma_pcm_convert(out, ma_format_f32, pcm->data() + offset * _bytesPerFrame, format, n * _channels, ma_dither_mode_none);
+        
+        out += n * _channels;
+        frame += n;
+        frameCount -= n;
+    }
+}
+
+std::shared_ptr<std::vector<std::uint8_t>> AudioHandler::cachedBlock(size_t block)
+{
+    // Audio thread - never waits on the cache, a busy lock counts as a miss
+    std::unique_lock<std::mutex> lock(_blockMutex, std::try_to_lock);
+    if (!lock.owns_lock()) return nullptr;
+    
+    for (auto& entry : _blockCache) {
+        if (entry.block == block) {
+            entry.lastUse = ++_blockClock;
+            return entry.pcm;
+        }
+    }
+    return nullptr;
+}
+
+void AudioHandler::requestBlock(size_t block)
+{
+    // Audio thread - the miss repeats next callback if the loader is busy or the queue full
+    {
+        std::unique_lock<std::mutex> lock(_loadMutex, std::try_to_lock);
+        if (!lock.owns_lock() || _loadQueue.size() >= LOAD_QUEUE_SIZE) return;
+        if (std::find(_loadQueue.begin(), _loadQueue.end(), block) != _loadQueue.end()) return;
+        _loadQueue.push_back(block);
+    }
+    _loadWake.notify_one();
+}
+
+void AudioHandler::blockLoadLoop()
+{
+    std::unique_lock<std::mutex> lock(_loadMutex);
+    while (true) {
+        _loadWake.wait(lock, [this]() { return _loadStop || !_loadQueue.empty(); });
+        if (_loadStop) return;
+        
+        size_t block = _loadQueue.front();
+        _loadQueue.erase(_loadQueue.begin());
+        
+        // Still under _loadMutex - clearPcm can't free the store mid-decode
+        size_t blockCount = (size_t)((_totalPcmFrames + PCM_BLOCK_FRAMES - 1) / PCM_BLOCK_FRAMES);
+        if ((_lazy || _compressed) && block < blockCount) {
+            getBlock(block);
+        }
+    }
+}
+
+std::shared_ptr<std::vector<std::uint8_t>> AudioHandler::getBlock(size_t block, bool cacheBlocks)
+{
+    {
+        std::lock_guard<std::mutex> lock(_blockMutex);
+        for (auto& entry : _blockCache) {
+            if (entry.block == block) {
+                entry.lastUse = ++_blockClock;
+                return entry.pcm;
+            }
+        }
+    }
+    
+    // Miss - decode outside the lock so other readers aren't held up
+    ma_uint64 firstFrame = (ma_uint64)block * PCM_BLOCK_FRAMES;
+    ma_uint32 frames = (ma_uint32)std::min<ma_uint64>(PCM_BLOCK_FRAMES, _totalPcmFrames - firstFrame);
+    auto pcm = std::make_shared<std::vector<std::uint8_t>>((size_t)frames * _bytesPerFrame);
+    
+    if (_lazy) {
+        decodeBlockFromFile(block, pcm->data(), frames);
+    } else {
+        decodeBlock(&_blockData[_blockOffsets[block]], _blockOffsets[block + 1] - _blockOffsets[block],
+                    pcm->data(), frames, _channels, ma_get_bytes_per_sample((ma_format)_sampleFormat));
+    }
+    
+    // Analysis reads keep their block to themselves
+    if (!cacheBlocks) return pcm;
+    
+    std::lock_guard<std::mutex> lock(_blockMutex);
+    
+    // Another reader may have decoded it meanwhile
+    for (auto& entry : _blockCache) {
+        if (entry.block == block) {
+            entry.lastUse = ++_blockClock;
+            return entry.pcm;
+        }
+    }
+    
+    if (_blockCache.size() < _blockCacheCapacity) {
+        _blockCache.push_back({ block, ++_blockClock, pcm });
+        _statPcmBytes.store(pcmBytes(), std::memory_order_relaxed);
+    } else {
+        auto oldest = std::min_element(_blockCache.begin(), _blockCache.end(),
+            [](const CachedBlock& a, const CachedBlock& b) { return a.lastUse < b.lastUse; });
+        *oldest = { block, ++_blockClock, pcm };
+    }
+    return pcm;
+}
+
+void AudioHandler::decodeBlockFromFile(size_t block, std::uint8_t* pcm, ma_uint32 frames)
+{
+    TraceScope trace("decoder read (block)");
+    ma_uint64 framesRead = 0;
+    {
+        std::lock_guard<std::mutex> lock(_decoderMutex);
+        if (_decoder) {
+            ma_decoder_seek_to_pcm_frame(_decoder, (ma_uint64)block * PCM_BLOCK_FRAMES);
+            ma_decoder_read_pcm_frames(_decoder, pcm, frames, &framesRead);
+        }
+    }
+    
+    _statDecodedBytes.fetch_add((ma_uint64)frames * _bytesPerFrame, std::memory_order_relaxed);
+    
+    // Short read (length estimate was off) - pad with silence
+    if (framesRead < frames) {
+        memset(pcm + framesRead * _bytesPerFrame, 0, (size_t)(frames - framesRead) * _bytesPerFrame);
+    }
+    
+    // Record peaks so the waveform fills in as the user scrubs
+    std::vector<float> samples((size_t)frames * _channels);
+    ma_pcm_convert(samples.data(), ma_format_f32, pcm, (ma_format)_sampleFormat, samples.size(), ma_dither_mode_none);
+    
+    std::lock_guard<std::mutex> lock(_blockMutex);
+    float* peaks = &_blockPeaks[block * _channels];
+    for (ma_uint32 c = 0; c < _channels; c++) peaks[c] = 0.0f;
+    for (size_t i = 0; i < samples.size(); i++) {
+        float& peak = peaks[i % _channels];
+        peak = std::max(peak, std::abs(samples[i]));
+    }
+    _peaksChanged.store(true);
+}
+
+void AudioHandler::prefetchBlocks(ma_uint64 firstFrame, ma_uint64 frameCount)
+{
+    if ((!_lazy && !_compressed) || _totalPcmFrames == 0) return;
+    
+    // Whatever the audio thread still misses is decoded here
+    if (!_loadThread.joinable()) {
+        _loadThread = std::thread(&AudioHandler::blockLoadLoop, this);
+    }
+    
+    // Requested span plus one neighbour either side, so the audio thread never decodes
+    size_t first = (size_t)(firstFrame / PCM_BLOCK_FRAMES);
+    size_t last = (size_t)(std::min(firstFrame + frameCount, _totalPcmFrames - 1) / PCM_BLOCK_FRAMES);
+    size_t blockCount = (size_t)((_totalPcmFrames + PCM_BLOCK_FRAMES - 1) / PCM_BLOCK_FRAMES);
+    
+    if (first > 0) first--;
+    last = std::min(last + 1, blockCount - 1);
+    
+    // Room for this grain and the one before it, so nothing prefetched is evicted before it plays
+    {
+        std::lock_guard<std::mutex> lock(_blockMutex);
+        _blockCacheCapacity = std::max(_blockCacheCapacity, (last - first + 1) * 2);
+    }
+    
+    for (size_t b = first; b <= last; b++) {
+        getBlock(b);
+    }
+}
+
+size_t AudioHandler::pcmBytes() const
+{
+    if (_isSequence || _peaksOnly) return 0;      // segments hold their own PCM, peaks have none
+    if (_compressed) return _blockData.size();
+    if (_lazy) return _blockCache.size() * (size_t)PCM_BLOCK_FRAMES * _bytesPerFrame;
+    return (size_t)(_totalPcmFrames * _bytesPerFrame);
+}
+
+bool AudioHandler::decodeParallel(const char* fileName, ma_uint64* framesRead)
+{
+    if (!isCompressedFormat(fileName)) return false;
+    
+    ma_uint64 minChunkFrames = (ma_uint64)_sampleRate * PARALLEL_MIN_CHUNK_SECONDS;
+    size_t numThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                         (size_t)(_totalPcmFrames / std::max<ma_uint64>(1, minChunkFrames)));
+    if (numThreads < 2) return false;
+    
+    auto startTime = std::chrono::steady_clock::now();
+    std::atomic<bool> ok(true);
+    
+    // MP3 has no index to seek by. Build the seek table once, on the decoder that is
+    // already open, and share it - every range scanning the file for its own costs
+    // a pass per thread. FLAC and Vorbis seek without one.
+    std::vector<ma_dr_mp3_seek_point> seekPoints;
+    if (_decoder->pBackendVTable == &g_ma_decoding_backend_vtable_mp3) {
+        TraceScope trace("decoder seek table");
+        ma_uint32 seekPointCount = PARALLEL_SEEK_POINTS;
+        seekPoints.resize(seekPointCount);
+        if (!ma_dr_mp3_calculate_seek_points(&((ma_mp3*)_decoder->pBackend)->dr, &seekPointCount, seekPoints.data())) {
+            seekPointCount = 0;
+        }
+        seekPoints.resize(seekPointCount);
+    }
+    
+    // Each range gets its own decoder; seeks are by exact output frame, so chunks
+    // butt up against each other with no gap or overlap
+    parallelRanges((size_t)_totalPcmFrames, (size_t)((_totalPcmFrames + numThreads - 1) / numThreads),
+        [&](size_t start, size_t end) {
+            TraceScope trace("decoder read (parallel chunk)");
+            ma_decoder decoder;
+            ma_decoder_config cfg = decoderConfig((ma_format)_sampleFormat, _channels, _sampleRate);
+            
+            if (ma_decoder_init_file(fileName, &cfg, &decoder) != MA_SUCCESS) {
+                ok.store(false);
+                return;
+            }
+            
+            // Only read while seeking, so one copy serves every thread
+            if (!seekPoints.empty() && decoder.pBackendVTable == &g_ma_decoding_backend_vtable_mp3) {
+                ma_dr_mp3_bind_seek_table(&((ma_mp3*)decoder.pBackend)->dr, (ma_uint32)seekPoints.size(), seekPoints.data());
+            }
+            
+            ma_uint64 preroll = std::min<ma_uint64>(start, PARALLEL_PREROLL_FRAMES);
+            ma_uint64 got = 0;
+            
+            if (ma_decoder_seek_to_pcm_frame(&decoder, start - preroll) != MA_SUCCESS) {
+                ok.store(false);
+            } else {
+                if (preroll > 0) {
+                    std::vector<std::uint8_t> scratch((size_t)preroll * _bytesPerFrame);
+                    ma_decoder_read_pcm_frames(&decoder, scratch.data(), preroll, &got);
+                }
+                if (got != preroll) {
+                    ok.store(false);
+                } else {
+                    ma_decoder_read_pcm_frames(&decoder, _audioData.data() + start * _bytesPerFrame, end - start, &got);
+                    if (got != end - start) ok.store(false);
+                }
+            }
+            
+            ma_decoder_uninit(&decoder);
+        });
+    
+    if (!ok.load()) {
+        std::cerr << "AudioHandler: Parallel decode failed, decoding serially" << std::endl;
+        ma_decoder_seek_to_pcm_frame(_decoder, 0);
+        return false;
+    }
+    
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "AudioHandler: Decoded on " << numThreads << " threads in " << ms << " ms" << std::endl;
+    
+    *framesRead = _totalPcmFrames;
+    return true;
+}
+
+bool AudioHandler::loadFromDiskCache(const char* fileName, ma_channel* channelMap)
+{
+    ma_uint64 capBytes = pcmCacheCapBytes();
+    fs::path cacheFile;
+    ma_uint64 sourceSize;
+    ma_int64 sourceMtime;
+    
+    if (capBytes == 0 || !pcmCacheEntry(fileName, cacheFile, sourceSize, sourceMtime)) return false;
+    
+    std::error_code ec;
+    if (!fs::exists(cacheFile, ec)) return false;
+    
+    MappedFile* mapped = new MappedFile();
+    const PcmCacheHeader* header = nullptr;
+    
+    if (mapped->map(cacheFile) && mapped->size >= sizeof(PcmCacheHeader)) {
+        header = (const PcmCacheHeader*)mapped->data;
+    }
+    
+    // Anything off (stale, truncated, other version) - ignore and decode again
+    bool valid = header
+        && memcmp(header->magic, "APCM", 4) == 0
+        && header->version == PCM_CACHE_VERSION
+        && header->sourceSize == sourceSize
+        && header->sourceMtime == sourceMtime
+        && header->channels > 0 && header->channels <= MA_MAX_CHANNELS
+        && header->dataOffset >= sizeof(PcmCacheHeader) + header->channels
+        && header->dataOffset + header->frameCount * ma_get_bytes_per_frame((ma_format)header->format, header->channels) <= mapped->size;
+    
+    if (!valid) {
+        delete mapped;
+        return false;
+    }
+    
+    _sampleFormat = (int)header->format;
+    _channels = header->channels;
+    _sampleRate = header->sampleRate;
+    _totalPcmFrames = header->frameCount;
+    _bytesPerFrame = ma_get_bytes_per_frame((ma_format)_sampleFormat, _channels);
+    memcpy(channelMap, mapped->data + sizeof(PcmCacheHeader), _channels);
+    
+    _mapped = mapped;
+    _pcm = mapped->data + header->dataOffset;
+    
+    // Mark as recently used for the LRU trim
+    fs::last_write_time(cacheFile, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void AudioHandler::writeDiskCache(const char* fileName, const ma_channel* channelMap)
+{
+    ma_uint64 capBytes = pcmCacheCapBytes();
+    fs::path cacheFile;
+    ma_uint64 sourceSize;
+    ma_int64 sourceMtime;
+    
+    if (capBytes == 0 || !pcmCacheEntry(fileName, cacheFile, sourceSize, sourceMtime)) return;
+    
+    size_t dataBytes = (size_t)(_totalPcmFrames * _bytesPerFrame);
+    if (dataBytes == 0 || dataBytes > capBytes) return;
+    
+    std::error_code ec;
+    fs::create_directories(cacheFile.parent_path(), ec);
+    
+    PcmCacheHeader header = {};
+    memcpy(header.magic, "APCM", 4);
+    header.version = PCM_CACHE_VERSION;
+    header.format = (ma_uint32)_sampleFormat;
+    header.channels = _channels;
+    header.sampleRate = _sampleRate;
+    header.dataOffset = (ma_uint32)((sizeof(PcmCacheHeader) + _channels + 63) / 64 * 64);
+    header.frameCount = _totalPcmFrames;
+    header.sourceSize = sourceSize;
+    header.sourceMtime = sourceMtime;
+    
+    // Write under a temporary name, then rename - readers never see a partial file
+    fs::path tmpFile = cacheFile;
+    tmpFile += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    
+    {
+        std::ofstream out(tmpFile, std::ios::binary);
+        if (!out) return;
+        
+        std::vector<char> prefix(header.dataOffset, 0);
+        memcpy(prefix.data(), &header, sizeof(header));
+        memcpy(prefix.data() + sizeof(header), channelMap, _channels);
+        out.write(prefix.data(), prefix.size());
+        out.write((const char*)_pcm, dataBytes);
+        
+        if (!out) {
+            out.close();
+            fs::remove(tmpFile, ec);
+            return;
+        }
+    }
+    
+    fs::rename(tmpFile, cacheFile, ec);
+    if (ec) {
+        fs::remove(tmpFile, ec);
+        return;
+    }
+    
+    trimPcmCache(cacheFile.parent_path(), capBytes);
+}
+
+void AudioHandler::compressPcm()
 {
-    initEngine();
+    ma_format format = (ma_format)_sampleFormat;
+    
+    if (format == ma_format_f32 || format == ma_format_unknown || _totalPcmFrames == 0) {
+        std::cout << "AudioHandler: PCM compression skipped (float or empty source)" << std::endl;
+        return;
+    }
+    
+    ma_uint32 bps = ma_get_bytes_per_sample(format);
+    size_t blockCount = (size_t)((_totalPcmFrames + PCM_BLOCK_FRAMES - 1) / PCM_BLOCK_FRAMES);
+    std::vector<std::vector<std::uint8_t>> blocks(blockCount);
+    
+    parallelRanges(blockCount, 16, [&](size_t first, size_t end) {
+        for (size_t b = first; b < end; b++) {
+            ma_uint64 frame = (ma_uint64)b * PCM_BLOCK_FRAMES;
+            ma_uint32 frames = (ma_uint32)std::min<ma_uint64>(PCM_BLOCK_FRAMES, _totalPcmFrames - frame);
+            encodeBlock(_pcm + frame * _bytesPerFrame, frames, _channels, bps, blocks[b]);
+        }
+    });
+    
+    _blockOffsets.resize(blockCount + 1);
+    size_t total = 0;
+    for (size_t b = 0; b < blockCount; b++) {
+        _blockOffsets[b] = total;
+        total += blocks[b].size();
+    }
+    _blockOffsets[blockCount] = total;
+    
+    _blockData.resize(total);
+    for (size_t b = 0; b < blockCount; b++) {
+        memcpy(_blockData.data() + _blockOffsets[b], blocks[b].data(), blocks[b].size());
+    }
+    
+    std::cout << "AudioHandler: Compressed PCM " << _totalPcmFrames * _bytesPerFrame / 1024 << " KB -> "
+              << total / 1024 << " KB (" << blockCount << " blocks)" << std::endl;
+    
+    std::vector<std::uint8_t>().swap(_audioData);
+    delete _mapped;
+    _mapped = nullptr;
+    _pcm = nullptr;
+    _compressed = true;
 }
 
-AudioHandler::~AudioHandler()
+void AudioHandler::clearPcm()
 {
-    cleanup();
+    // A sequence's segments are its PCM store - freed once the audio thread can't reach them
+    std::vector<std::unique_ptr<SequenceSegment>> segments;
+    {
+        std::lock_guard<std::mutex> tracksLock(_trackMutex);
+        segments.swap(_segments);
+        _isSequence = false;
+    }
+    segments.clear();
+    
+    // Waits out a block the loader is decoding from this store
+    std::lock_guard<std::mutex> loadLock(_loadMutex);
+    _loadQueue.clear();
+    
+    // swap() rather than clear() so the memory is actually returned
+    std::vector<std::uint8_t>().swap(_audioData);
+    std::vector<std::uint8_t>().swap(_blockData);
+    _blockOffsets.clear();
+    delete _mapped;
+    _mapped = nullptr;
+    _pcm = nullptr;
+    _compressed = false;
+    _lazy = false;
+    _peaksOnly = false;
+    
+    std::lock_guard<std::mutex> lock(_blockMutex);
+    _blockCache.clear();
+    _blockCacheCapacity = BLOCK_CACHE_SIZE;
+    _blockPeaks.clear();
+    _peaksChanged.store(false);
+    _statPcmBytes.store(0);
+}
+
+void AudioHandler::setSoloChannel(int channel)
+{
+    _soloChannel.store(channel >= 0 && channel < (int)_channels ? channel : -1);
+}
+
+void AudioHandler::playAtFrame(int frame)
+{
+    TraceScope trace("playAtFrame");
+    logScrubRequest(frame);
+    
+    if (!_fileLoaded.load() || !_sound || !_engine) return;
+    
+    _lastPlayNs.store(steadyNs(), std::memory_order_relaxed);
+    autoTunePeriod();
+    
+    _statPlayCalls.fetch_add(1, std::memory_order_relaxed);
+    int lastFrame = _lastPlayedFrame.load();
+    
+    // Skip if same frame
+    if (frame == lastFrame) {
+        _statSkipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+    lockTimed(lock);
+    
+    // Double-check after acquiring lock - a load or device restart may have run
+    if (!_sound || !_engine) return;
+    
+    // PCM range for this frame - exact boundaries, so NTSC rates don't drift
+    ma_uint64 pcmStart = frameStart(frame);
+    ma_uint64 samplesPerVideoFrame = frameStart(frame + 1) - pcmStart;
+    
+    // Stop time runs on the engine clock, which needn't match the file rate
+    ma_uint64 engineSamplesPerVideoFrame = samplesAtFrame(frame + 1, _engineSampleRate) - samplesAtFrame(frame, _engineSampleRate);
+    
+    // Handle out of bounds - mixer tracks may run on past the end of this file
+    ma_uint64 mixFrames = _mixPcmFrames.load();
+    if (mixFrames > 0 && pcmStart >= mixFrames) {
+        _statSkipped.fetch_add(1, std::memory_order_relaxed);
+        ma_sound_stop(_sound);
+        _lastPlayedFrame.store(frame);
+        return;
+    }
+    
+    // Lazy and compressed: make sure this frame's blocks are decoded before the audio thread wants them.
+    // The engine pulls a whole period at a time, so a grain can read up to one past its frame.
+    ma_uint64 readAhead = ((ma_uint64)_periodFrames.load() * _sampleRate + _engineSampleRate - 1) / std::max<ma_uint32>(1, _engineSampleRate);
+    prefetchBlocks(pcmStart, samplesPerVideoFrame + readAhead);
+    if (_isSequence) {
+        prepareSegments(pcmStart, samplesPerVideoFrame + readAhead);
+    }
+    
+    // Previous grain hadn't run its course - this request took over from it
+    if (ma_sound_is_playing(_sound)) {
+        _statCoalesced.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    // Stop any current playback and clear stop time
+    ma_sound_stop(_sound);
+    ma_sound_set_stop_time_in_pcm_frames(_sound, (ma_uint64)-1);  // Clear previous stop time
+    
+    // Seek to frame position
+    ma_sound_seek_to_pcm_frame(_sound, pcmStart);
+    
+    // Get current engine time and set stop time (one video frame from now)
+    ma_uint64 engineTime = ma_engine_get_time_in_pcm_frames(_engine);
+    ma_sound_set_stop_time_in_pcm_frames(_sound, engineTime + engineSamplesPerVideoFrame);
+    
+    // Start playback (will auto-stop after one frame duration)
+    ma_sound_start(_sound);
+    
+    _lastPlayedFrame.store(frame);
+}
+
+void AudioHandler::stop()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    if (_sound) {
+        ma_sound_stop(_sound);
+    }
+    _lastPlayedFrame.store(-9999);
+}
+
+void AudioHandler::setFps(float fps)
+{
+    ma_uint32 numerator, denominator;
+    rationalFps(std::max(1.0f, fps), numerator, denominator);
+    setFps(numerator, denominator);
+}
+
+void AudioHandler::setFps(ma_uint32 numerator, ma_uint32 denominator)
+{
+    if (numerator == 0 || denominator == 0) return;
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    ma_uint32 divisor = std::gcd(numerator, denominator);
+    if (numerator / divisor == _fpsNum && denominator / divisor == _fpsDen) return;
+    applyFps(numerator, denominator);
+    timingChanged();
+}
+
+void AudioHandler::setSubFrameOffsetSamples(ma_int64 samples)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    if (!_subFrameOffsetInMs && samples == _subFrameOffsetSamples) return;
+    _subFrameOffsetSamples = samples;
+    _subFrameOffsetInMs = false;
+    timingChanged();
+}
+
+void AudioHandler::setSubFrameOffsetMs(double ms)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    if (_subFrameOffsetInMs && ms == _subFrameOffsetMs) return;
+    _subFrameOffsetMs = ms;
+    _subFrameOffsetInMs = true;
+    timingChanged();
+}
+
+ma_int64 AudioHandler::getSubFrameOffsetSamples() const
+{
+    if (!_subFrameOffsetInMs) return _subFrameOffsetSamples;
+    return (ma_int64)std::llround(_subFrameOffsetMs * _sampleRate / 1000.0);
+}
+
+void AudioHandler::timingChanged()
+{
+    // PCM and waveform don't depend on frame timing - only the mapping does.
+    // A sequence's record points are frames, so its length moves with fps.
+    if (_isSequence) {
+        updateSequenceTiming();
+    }
+    buildFrameTable();
+    updateTrackTiming();
+    _features.clear();
+    _featureFrames = 0;
+    _lastPlayedFrame.store(-9999);
+    updateWaveformStats();
+}
+
+void AudioHandler::applyFps(ma_uint32 numerator, ma_uint32 denominator)
+{
+    ma_uint32 divisor = std::gcd(numerator, denominator);
+    _fpsNum = numerator / divisor;
+    _fpsDen = denominator / divisor;
+    _fps = (float)((double)_fpsNum / _fpsDen);
+}
+
+ma_uint64 AudioHandler::samplesAtFrame(int frame, ma_uint32 sampleRate) const
+{
+    // Floor of frame * rate * den / num - no 64-bit overflow for any int frame at 192 kHz
+    if (frame <= 0) return 0;
+    return (ma_uint64)frame * sampleRate * _fpsDen / _fpsNum;
+}
+
+ma_uint64 AudioHandler::frameStart(int frame) const
+{
+    if (frame >= 0 && (size_t)frame < _frameStarts.size()) return _frameStarts[frame];
+    
+    // Delayed audio starts before the file does - the first grains play from sample 0
+    ma_int64 start = (ma_int64)samplesAtFrame(frame, _sampleRate) - getSubFrameOffsetSamples();
+    return start > 0 ? (ma_uint64)start : 0;
+}
+
+void AudioHandler::buildFrameTable()
+{
+    // Whole frames only - a trailing partial frame isn't counted
+    ma_uint64 frames = _sampleRate == 0 ? 0 : _totalPcmFrames * _fpsNum / ((ma_uint64)_sampleRate * _fpsDen);
+    int lengthInFrames = (int)std::min<ma_uint64>(frames, 0x7FFFFFFE);
+    
+    // Filled through frameStart() while the table is empty, so both agree past its end
+    std::vector<ma_uint64> starts((size_t)lengthInFrames + 1);
+    _frameStarts.clear();
+    for (int frame = 0; frame <= lengthInFrames; frame++) {
+        starts[frame] = frameStart(frame);
+    }
+    _frameStarts.swap(starts);
+    _lengthInFrames.store(lengthInFrames);
+}
+
+void AudioHandler::lockTimed(std::unique_lock<std::mutex>& lock)
+{
+    if (lock.try_lock()) return;
+    
+    // Busy (load, waveform, features) - count the wait
+    long long start = steadyNs();
+    lock.lock();
+    _statLockWaits.fetch_add(1, std::memory_order_relaxed);
+    _statLockWaitNs.fetch_add((ma_uint64)(steadyNs() - start), std::memory_order_relaxed);
+}
+
+void AudioHandler::deviceCallback(void* out, ma_uint32 frameCount, ma_uint32 sampleRate)
+{
+    long long start = steadyNs();
+    ma_engine_read_pcm_frames(_engine, out, frameCount, nullptr);
+    long long end = steadyNs();
+    
+    long long periodNs = (long long)frameCount * 1000000000LL / std::max(1u, sampleRate);
+    long long duration = end - start;
+    long long last = _lastCallbackNs.exchange(start, std::memory_order_relaxed);
+    
+    // Only this thread writes these - plain load/store is enough for the maxima
+    const auto relaxed = std::memory_order_relaxed;
+    _cbPeriodFrames.store(frameCount, relaxed);
+    _cbSampleRate.store(sampleRate, relaxed);
+    _cbCount.fetch_add(1, relaxed);
+    _cbTotalNs.fetch_add((ma_uint64)duration, relaxed);
+    if ((ma_uint64)duration > _cbMaxNs.load(relaxed)) _cbMaxNs.store((ma_uint64)duration, relaxed);
+    _cbDurationHist[callbackHistogramBucket(duration)].fetch_add(1, relaxed);
+    
+    bool late = false;
+    if (last > 0) {
+        long long interval = start - last;
+        long long jitter = std::abs(interval - periodNs);
+        _cbIntervals.fetch_add(1, relaxed);
+        _cbJitterTotalNs.fetch_add((ma_uint64)jitter, relaxed);
+        if ((ma_uint64)jitter > _cbJitterMaxNs.load(relaxed)) _cbJitterMaxNs.store((ma_uint64)jitter, relaxed);
+        _cbJitterHist[callbackHistogramBucket(jitter)].fetch_add(1, relaxed);
+        
+        // The device waited over two periods for this call
+        late = interval > 2 * periodNs;
+    }
+    
+    // Slower than real time, or late
+    if (duration > periodNs || late) {
+        _statUnderruns.fetch_add(1, relaxed);
+    }
+}
+
+void AudioHandler::deviceNotification(int type)
+{
+    switch (type) {
+        case ma_device_notification_type_interruption_began:
+            _cbInterruptions.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "AudioHandler: Audio device interrupted" << std::endl;
+            break;
+        case ma_device_notification_type_rerouted:
+            _cbReroutes.fetch_add(1, std::memory_order_relaxed);
+            std::cout << "AudioHandler: Audio device rerouted" << std::endl;
+            break;
+        default:
+            break;
+    }
+}
+
+AudioHandler::CallbackStats AudioHandler::getCallbackStats() const
+{
+    const auto relaxed = std::memory_order_relaxed;
+    CallbackStats stats;
+    stats.periodFrames = _cbPeriodFrames.load(relaxed);
+    stats.sampleRate = _cbSampleRate.load(relaxed);
+    stats.callbacks = _cbCount.load(relaxed);
+    
+    ma_uint64 intervals = _cbIntervals.load(relaxed);
+    stats.meanMs = stats.callbacks ? _cbTotalNs.load(relaxed) / 1e6 / stats.callbacks : 0.0;
+    stats.maxMs = _cbMaxNs.load(relaxed) / 1e6;
+    stats.jitterMeanMs = intervals ? _cbJitterTotalNs.load(relaxed) / 1e6 / intervals : 0.0;
+    stats.jitterMaxMs = _cbJitterMaxNs.load(relaxed) / 1e6;
+    stats.underruns = _statUnderruns.load(relaxed);
+    stats.interruptions = _cbInterruptions.load(relaxed);
+    stats.reroutes = _cbReroutes.load(relaxed);
+    
+    for (int i = 0; i < CALLBACK_HISTOGRAM_BUCKETS; i++) {
+        stats.durationHistogram[i] = _cbDurationHist[i].load(relaxed);
+        stats.jitterHistogram[i] = _cbJitterHist[i].load(relaxed);
+    }
+    return stats;
+}
+
+void AudioHandler::updateWaveformStats()
+{
+    _statWaveformBytes.store((_waveform.size() + _features.size() + _blockPeaks.size()) * sizeof(float),
+                             std::memory_order_relaxed);
+}
+
+AudioHandler::Stats AudioHandler::getStats() const
+{
+    Stats stats;
+    stats.loadMs = _statLoadMs.load(std::memory_order_relaxed);
+    stats.decodedBytes = _statDecodedBytes.load(std::memory_order_relaxed);
+    stats.pcmBytes = _statPcmBytes.load(std::memory_order_relaxed);
+    stats.waveformBytes = _statWaveformBytes.load(std::memory_order_relaxed);
+    stats.playCalls = _statPlayCalls.load(std::memory_order_relaxed);
+    stats.skippedFrames = _statSkipped.load(std::memory_order_relaxed);
+    stats.coalescedFrames = _statCoalesced.load(std::memory_order_relaxed);
+    stats.lockWaits = _statLockWaits.load(std::memory_order_relaxed);
+    stats.lockWaitMs = _statLockWaitNs.load(std::memory_order_relaxed) / 1e6;
+    stats.underruns = _statUnderruns.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AudioHandler::resetStats()
+{
+    _statPlayCalls.store(0);
+    _statSkipped.store(0);
+    _statCoalesced.store(0);
+    _statLockWaits.store(0);
+    _statLockWaitNs.store(0);
+    _statUnderruns.store(0);
+    
+    // Next interval starts fresh too
+    _lastCallbackNs.store(0);
+    _cbCount.store(0);
+    _cbIntervals.store(0);
+    _cbTotalNs.store(0);
+    _cbMaxNs.store(0);
+    _cbJitterTotalNs.store(0);
+    _cbJitterMaxNs.store(0);
+    _cbInterruptions.store(0);
+    _cbReroutes.store(0);
+    for (int i = 0; i < CALLBACK_HISTOGRAM_BUCKETS; i++) {
+        _cbDurationHist[i].store(0);
+        _cbJitterHist[i].store(0);
+    }
+}
+
+ma_uint64 AudioHandler::renderOutput(float* out, ma_uint64 frameCount)
+{
+    // No lock - same as the audio thread, which never takes _mutex
+    if (_deviceMode != DEVICE_NONE || !_engine) return 0;
+    
+    ma_uint64 framesRead = 0;
+    ma_engine_read_pcm_frames(_engine, out, frameCount, &framesRead);
+    return framesRead;
+}
+
+long long AudioHandler::getPlaybackCursor()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    ma_uint64 cursor = 0;
+    if (!_sound || ma_sound_get_cursor_in_pcm_frames(_sound, &cursor) != MA_SUCCESS) return -1;
+    return (long long)cursor;
+}
+
+int AudioHandler::getFileLengthInFrames() const
+{
+    if (!_fileLoaded.load()) return 0;
+    return _lengthInFrames.load();
+}
+
+void AudioHandler::generateWaveform(int pixelWidth)
+{
+    TraceScope trace("generateWaveform");
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    _waveform.clear();
+    waveformWidth = 0;
+    
+    if (!_fileLoaded.load() || _totalPcmFrames == 0 || pixelWidth <= 0) return;
+    
+    _waveform.assign((size_t)pixelWidth * _channels, 0.0f);
+    
+    if (_isSequence) {
+        sequenceWaveform(pixelWidth);
+        _peaksChanged.store(false);
+        waveformWidth = pixelWidth;
+        buildTrackWaveforms();
+        updateWaveformStats();
+        return;
+    }
+    
+    // Lazy mode, or a followed file once its block peaks are at least as fine as the
+    // pixels - a growing file then redraws without rescanning the whole store
+    if (_lazy || _peaksOnly || (!_blockPeaks.empty() && _blockPeaks.size() / _channels >= (size_t)pixelWidth)) {
+        // Only blocks decoded so far are known - everything else stays flat
+        std::lock_guard<std::mutex> blockLock(_blockMutex);
+        size_t blockCount = _blockPeaks.size() / _channels;
+        
+        for (int x = 0; x < pixelWidth; x++) {
+            size_t first = (size_t)x * blockCount / pixelWidth;
+            size_t end = std::max(first + 1, (size_t)(x + 1) * blockCount / pixelWidth);
+            
+            for (size_t b = first; b < end && b < blockCount; b++) {
+                for (ma_uint32 c = 0; c < _channels; c++) {
+                    float& peak = _waveform[(size_t)c * pixelWidth + x];
+                    peak = std::max(peak, _blockPeaks[b * _channels + c]);
+                }
+            }
+        }
+        
+        _peaksChanged.store(false);
+        waveformWidth = pixelWidth;
+        buildTrackWaveforms();
+        updateWaveformStats();
+        return;
+    }
+    
+    size_t totalSamples = (size_t)_totalPcmFrames;
+    size_t samplesPerPixel = std::max(size_t(1), totalSamples / pixelWidth);
+    
+    const size_t chunkFrames = 4096;
+    std::vector<float> chunk(chunkFrames * _channels);
+    BlockCursor cursor;
+    
+    for (int x = 0; x < pixelWidth; x++) {
+        size_t start = x * samplesPerPixel;
+        size_t end = std::min(start + samplesPerPixel, totalSamples);
+        
+        for (size_t pos = start; pos < end; pos += chunkFrames) {
+            size_t n = std::min(chunkFrames, end - pos);
+            readFloat(pos, chunk.data(), n, &cursor);
+            
+            for (size_t i = 0; i < n; i++) {
+                const float* s = &chunk[i * _channels];
+                for (ma_uint32 c = 0; c < _channels; c++) {
+                    float& peak = _waveform[(size_t)c * pixelWidth + x];
+                    peak = std::max(peak, std::abs(s[c]));
+                }
+            }
+        }
+    }
+    
+    waveformWidth = pixelWidth;
+    buildTrackWaveforms();
+    updateWaveformStats();
+}
+
+const float* AudioHandler::getWaveform(int channel) const
+{
+    if (waveformWidth <= 0 || channel < 0 || channel >= (int)_channels) return nullptr;
+    return _waveform.data() + (size_t)channel * waveformWidth;
+}
+
+void AudioHandler::computeFeatures()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    buildFeatures();
+}
+
+float AudioHandler::getFeature(int feature, int frame) const
+{
+    if (feature < 0 || feature >= FEATURE_COUNT) return 0.0f;
+    if (frame < 0 || frame >= _featureFrames) return 0.0f;
+    return _features[(size_t)frame * FEATURE_COUNT + feature];
+}
+
+void AudioHandler::buildFeatures()
+{
+    TraceScope trace("buildFeatures");
+    _features.clear();
+    _featureFrames = 0;
+    
+    if (_totalPcmFrames == 0 || _channels == 0 || _sampleRate == 0) return;
+    
+    if (_peaksOnly) {
+        std::cerr << "AudioHandler: Features need the audio - the file was loaded for its peaks only" << std::endl;
+        return;
+    }
+    
+    // Would open and decode every segment of the edit
+    if (_isSequence) {
+        std::cerr << "AudioHandler: Features are not available for sequences" << std::endl;
+        return;
+    }
+    
+    int frameCount = _lengthInFrames.load();
+    if (frameCount <= 0) return;
+    
+    _features.assign((size_t)frameCount * FEATURE_COUNT, 0.0f);
+    _featureFrames = frameCount;
+    
+    // Frames are independent, so split the timeline into one range per core.
+    // Lazy mode streams through one decoder - keep that to a single sequential pass.
+    size_t minPerThread = _lazy ? (size_t)frameCount : 64;
+    parallelRanges(frameCount, minPerThread, [this](size_t first, size_t end) {
+        buildFeatureRange((int)first, (int)end);
+    });
+    updateWaveformStats();
+}
+
+void AudioHandler::extendFeatures(std::vector<float>&& kept, int keptFrames)
+{
+    // Follow mode, caller holds _mutex. Frames before the old end keep their values;
+    // the old last frame was short, so it is binned again along with the new ones.
+    if (keptFrames <= 0) return;            // never built - computeFeatures() does the lot
+    TraceScope trace("extendFeatures");
+    
+    int frameCount = _lengthInFrames.load();
+    if (frameCount <= 0) return;
+    int firstFrame = std::min(keptFrames - 1, frameCount);
+    
+    _features = std::move(kept);
+    _features.resize((size_t)frameCount * FEATURE_COUNT, 0.0f);
+    _featureFrames = frameCount;
+    
+    size_t minPerThread = _lazy ? (size_t)frameCount : 64;
+    parallelRanges((size_t)(frameCount - firstFrame), minPerThread, [this, firstFrame](size_t first, size_t end) {
+        buildFeatureRange(firstFrame + (int)first, firstFrame + (int)end);
+    });
+    updateWaveformStats();
+}
+
+void AudioHandler::buildFeatureRange(int firstFrame, int endFrame)
+{
+    const size_t totalSamples = (size_t)_totalPcmFrames;
+    const float twoPi = 6.28318530718f;
+    
+    // One-pole crossovers: low < 250 Hz, high > 4 kHz, mid in between
+    const float aLow = 1.0f - std::exp(-twoPi * 250.0f / _sampleRate);
+    const float aHigh = 1.0f - std::exp(-twoPi * 4000.0f / _sampleRate);
+    float lpLow = 0.0f, lpHigh = 0.0f;
+    
+    // Per-thread float copy of the span being analysed
+    std::vector<float> span;
+    BlockCursor cursor;
+    auto load = [&](size_t start, size_t end) {
+        span.resize((end - start) * _channels);
+        if (end > start) readFloat(start, span.data(), end - start, &cursor);
+    };
+    auto mono = [&](size_t i) {
+        const float* s = &span[i * _channels];
+        float sum = 0.0f;
+        for (ma_uint32 c = 0; c < _channels; c++) sum += s[c];
+        return sum / _channels;
+    };
+    
+    // Settle the filters on audio before this range so thread boundaries match a serial pass
+    size_t rangeStart = std::min((size_t)frameStart(firstFrame), totalSamples);
+    size_t warmup = std::min(rangeStart, (size_t)4096);
+    load(rangeStart - warmup, rangeStart);
+    for (size_t i = 0; i < warmup; i++) {
+        float s = mono(i);
+        lpLow += aLow * (s - lpLow);
+        lpHigh += aHigh * (s - lpHigh);
+    }
+    
+    for (int frame = firstFrame; frame < endFrame; frame++) {
+        size_t start = std::min((size_t)frameStart(frame), totalSamples);
+        size_t end = std::min((size_t)frameStart(frame + 1), totalSamples);
+        load(start, end);
+        
+        double sumSq = 0.0, sumLow = 0.0, sumMid = 0.0, sumHigh = 0.0;
+        float peak = 0.0f;
+        
+        for (size_t i = 0; i < end - start; i++) {
+            const float* s = &span[i * _channels];
+            for (ma_uint32 c = 0; c < _channels; c++) {
+                peak = std::max(peak, std::abs(s[c]));
+            }
+            
+            float m = mono(i);
+            lpLow += aLow * (m - lpLow);
+            lpHigh += aHigh * (m - lpHigh);
+            
+            float low = lpLow;
+            float mid = lpHigh - lpLow;
+            float high = m - lpHigh;
+            
+            sumSq += m * m;
+            sumLow += low * low;
+            sumMid += mid * mid;
+            sumHigh += high * high;
+        }
+        
+        double n = (double)std::max(size_t(1), end - start);
+        float* out = &_features[(size_t)frame * FEATURE_COUNT];
+        out[FEATURE_RMS] = (float)std::sqrt(sumSq / n);
+        out[FEATURE_PEAK] = peak;
+        out[FEATURE_LOW] = (float)std::sqrt(sumLow / n);
+        out[FEATURE_MID] = (float)std::sqrt(sumMid / n);
+        out[FEATURE_HIGH] = (float)std::sqrt(sumHigh / n);
+    }
+}
+
+bool AudioHandler::estimateSyncOffset(const char* referenceFile, double& delaySeconds, float& confidence)
+{
+    TraceScope trace("estimateSyncOffset");
+    auto start = std::chrono::steady_clock::now();
+    if (!referenceFile || !referenceFile[0]) return false;
+    
+    // The reference decodes on its own thread while the loaded file is scanned
+    std::vector<float> reference;
+    bool referenceOk = false;
+    std::thread referenceThread([&]() { referenceOk = syncReferenceOnsets(referenceFile, reference); });
+    
+    std::vector<float> loaded;
+    bool sequence = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        
+        // Would open and decode every segment of the edit
+        sequence = _isSequence;
+        if (_fileLoaded.load() && !_peaksOnly && !_isSequence && _sampleRate > 0 && _channels > 0) {
+            ma_uint64 frames = std::min(_totalPcmFrames, (ma_uint64)(SYNC_MAX_SECONDS * _sampleRate));
+            size_t bins = (size_t)(frames * SYNC_ENVELOPE_RATE / _sampleRate);
+            std::vector<double> sums(bins, 0.0);
+            
+            // Bins are independent; lazy mode streams through one decoder, so keep it sequential
+            parallelRanges(bins, _lazy ? bins : 1000, [&](size_t first, size_t end) {
+                // A second of audio at a time
+                std::vector<float> span;
+                BlockCursor cursor;
+                for (size_t chunk = first; chunk < end; chunk += SYNC_ENVELOPE_RATE) {
+                    size_t chunkEnd = std::min(end, chunk + SYNC_ENVELOPE_RATE);
+                    ma_uint64 spanStart = syncBinStart(chunk, _sampleRate);
+                    ma_uint64 spanFrames = syncBinStart(chunkEnd, _sampleRate) - spanStart;
+                    span.resize((size_t)spanFrames * _channels);
+                    if (spanFrames > 0) readFloat(spanStart, span.data(), spanFrames, &cursor);
+                    
+                    for (size_t bin = chunk; bin < chunkEnd; bin++) {
+                        double sum = 0.0;
+                        for (ma_uint64 i = syncBinStart(bin, _sampleRate); i < syncBinStart(bin + 1, _sampleRate); i++) {
+                            const float* s = &span[(size_t)(i - spanStart) * _channels];
+                            float mono = 0.0f;
+                            for (ma_uint32 c = 0; c < _channels; c++) mono += s[c];
+                            sum += std::fabs(mono / _channels);
+                        }
+                        sums[bin] = sum;
+                    }
+                }
+            });
+            loaded = syncOnsets(sums, _sampleRate);
+        }
+    }
+    referenceThread.join();
+    
+    if (!referenceOk) {
+        std::cerr << "AudioHandler: Cannot read sync reference " << referenceFile << std::endl;
+        return false;
+    }
+    if (sequence) {
+        std::cerr << "AudioHandler: Sync is not available for sequences" << std::endl;
+        return false;
+    }
+    if (loaded.empty()) {
+        std::cerr << "AudioHandler: Cannot sync - no file loaded" << std::endl;
+        return false;
+    }
+    
+    double lag = syncCorrelate(reference, loaded, confidence);
+    delaySeconds = lag / SYNC_ENVELOPE_RATE;
+    
+    std::cout << "AudioHandler: Sync offset " << delaySeconds << "s (confidence " << confidence << ") in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    return true;
+}
+
+AudioHandler::Timecode AudioHandler::getTimecode()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _timecode;
 }
 
-bool AudioHandler::initEngine()
+bool AudioHandler::timecodeDelay(const Timecode& timecode, const char* plateTimecode, double& delaySeconds)
 {
-    if (_initialized.load()) return true;
-    
-    _engine = new ma_engine();
+    if (!timecode.valid) return false;
     
-    ma_engine_config config = ma_engine_config_init();
-    config.channels = 2;
-    config.sampleRate = 48000;
-    config.periodSizeInFrames = 128;  // Very low latency for scrubbing
+    std::lock_guard<std::mutex> lock(_mutex);
     
-    if (ma_engine_init(&config, _engine) != MA_SUCCESS) {
-        std::cerr << "AudioHandler: Failed to init engine" << std::endl;
-        delete _engine;
-        _engine = nullptr;
+    // Timecode counts at the nominal rate; time runs at the exact one
+    int nominalFps = (int)std::lround((double)_fpsNum / _fpsDen);
+    int plateFrames = 0;
+    if (!plateTimecode || !parseSequenceTime(plateTimecode, nominalFps, plateFrames)) {
+        std::cerr << "AudioHandler: Bad plate timecode '" << (plateTimecode ? plateTimecode : "") << "'" << std::endl;
         return false;
     }
     
-    _sampleRate = ma_engine_get_sample_rate(_engine);
-    _initialized.store(true);
-    std::cout << "AudioHandler: Engine ready @ " << _sampleRate << " Hz" << std::endl;
+    if (timecode.fpsNum && (ma_uint64)timecode.fpsNum * _fpsDen != (ma_uint64)_fpsNum * timecode.fpsDen) {
+        std::cerr << "AudioHandler: Audio timecode is at " << (double)timecode.fpsNum / timecode.fpsDen
+                  << " fps, the timeline at " << _fps << " fps" << std::endl;
+    }
+    
+    double audioSeconds = (double)timecode.samplesSinceMidnight / timecode.sampleRate;
+    double plateSeconds = (double)plateFrames * _fpsDen / _fpsNum;
+    delaySeconds = std::fmod(audioSeconds - plateSeconds, SECONDS_PER_DAY);
+    if (delaySeconds > SECONDS_PER_DAY / 2) delaySeconds -= SECONDS_PER_DAY;
+    if (delaySeconds < -SECONDS_PER_DAY / 2) delaySeconds += SECONDS_PER_DAY;
+    
+    std::cout << "AudioHandler: Timecode offset " << delaySeconds << "s against plate " << plateTimecode << std::endl;
     return true;
 }
 
-void AudioHandler::cleanup()
+int AudioHandler::setTrack(const void* owner, int slot, const char* fileName)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    
-    _fileLoaded.store(false);
+    TraceScope trace("setTrack");
+    std::string path = fileName ? fileName : "";
+    {
+        // Already holds this file - every instance of a node asks for the same thing
+        std::lock_guard<std::mutex> lock(_mutex);
+        int index = findTrack(owner, slot);
+        if (index > 0 ? _tracks[index - 1]->path == path : path.empty()) return index;
+    }
     
-    if (_sound) {
-        ma_sound_stop(_sound);
-        ma_sound_uninit(_sound);
-        delete _sound;
-        _sound = nullptr;
+    // Decoded without this handler's lock - only installing the track needs it
+    std::unique_ptr<MixTrack> track;
+    if (!path.empty()) {
+        track.reset(new MixTrack());
+        track->handler.reset(new AudioHandler(DEVICE_OFF));
+        track->handler->setPeaksOnly(peaksOnlyLoad());
+        track->owner = owner;
+        track->slot = slot;
+        track->path = path;
+        if (!track->handler->loadFile(path.c_str(), _fps)) track.reset();
     }
     
-    if (_decoder) {
-        ma_decoder_uninit(_decoder);
-        delete _decoder;
-        _decoder = nullptr;
+    // Freed after both locks are gone - a track's teardown takes its own
+    std::unique_ptr<MixTrack> old;
+    int result = -1;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        int index = findTrack(owner, slot);
+        if (index <= 0 && track) {
+            // The first free index - other owners' tracks keep theirs
+            index = 1;
+            while (index <= (int)_tracks.size() && _tracks[index - 1]) index++;
+            if (index >= MAX_TRACKS) {
+                old = std::move(track);
+                index = -1;
+            }
+        }
+        if (index <= 0) return -1;
+        
+        if (track) {
+            // Ready to mix before the audio thread can see it
+            track->rateRatio = (double)track->handler->getSampleRate() / std::max(1u, _sampleRate);
+            track->scratch.resize(mixScratchFloats(track->rateRatio));
+            if (waveformWidth > 0) track->handler->generateWaveform(waveformWidth);
+            result = index;
+        }
+        {
+            std::lock_guard<std::mutex> tracksLock(_trackMutex);
+            if (index > (int)_tracks.size()) _tracks.resize(index);
+            old = std::move(_tracks[index - 1]);
+            _tracks[index - 1] = std::move(track);
+            while (!_tracks.empty() && !_tracks.back()) _tracks.pop_back();
+            _trackGain[index].store(1.0f);
+            _trackMute[index].store(false);
+            _trackCount.store((int)_tracks.size());
+        }
+        updateTrackTiming();
+        buildTrackWaveforms();
+        _lastPlayedFrame.store(-9999);
+    }
+    return result;
+}
+
+int AudioHandler::findTrack(const void* owner, int slot) const
+{
+    // Callers hold _mutex
+    for (size_t t = 0; t < _tracks.size(); t++) {
+        if (_tracks[t] && _tracks[t]->owner == owner && _tracks[t]->slot == slot) return (int)t + 1;
+    }
+    return -1;
+}
+
+void AudioHandler::attachOwner(const void* owner)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& entry : _owners) {
+        if (entry.first == owner) {
+            entry.second++;
+            return;
+        }
+    }
+    _owners.push_back({ owner, 1 });
+}
+
+void AudioHandler::detachOwner(const void* owner)
+{
+    // The last user of an owner takes its tracks with it. Freed after both locks are gone.
+    std::vector<std::unique_ptr<MixTrack>> old;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto entry = std::find_if(_owners.begin(), _owners.end(),
+            [owner](const std::pair<const void*, int>& e) { return e.first == owner; });
+        if (entry == _owners.end() || --entry->second > 0) return;
+        _owners.erase(entry);
+        {
+            std::lock_guard<std::mutex> tracksLock(_trackMutex);
+            for (auto& track : _tracks) {
+                if (track && track->owner == owner) old.push_back(std::move(track));
+            }
+            while (!_tracks.empty() && !_tracks.back()) _tracks.pop_back();
+            _trackCount.store((int)_tracks.size());
+        }
+        if (!old.empty()) {
+            updateTrackTiming();
+            buildTrackWaveforms();
+            _lastPlayedFrame.store(-9999);
+        }
     }
     
-    if (_engine) {
-        ma_engine_uninit(_engine);
-        delete _engine;
-        _engine = nullptr;
+    // Nor does it keep the file followed
+    setFollowFile(owner, false);
+}
+
+void AudioHandler::clearTracks()
+{
+    // Freed after both locks are gone - a track's teardown takes its own
+    std::vector<std::unique_ptr<MixTrack>> old;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        {
+            std::lock_guard<std::mutex> tracksLock(_trackMutex);
+            old.swap(_tracks);
+            _trackCount.store(0);
+        }
+        updateTrackTiming();
+        buildTrackWaveforms();
     }
+}
+
+void AudioHandler::setTrackGain(int track, float gain)
+{
+    if (track >= 0 && track < MAX_TRACKS) _trackGain[track].store(gain);
+}
+
+void AudioHandler::setTrackMute(int track, bool mute)
+{
+    if (track >= 0 && track < MAX_TRACKS) _trackMute[track].store(mute);
+}
+
+void AudioHandler::setTrackOffset(int track, int frames)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
     
-    delete[] waveformDataL;
-    delete[] waveformDataR;
-    waveformDataL = nullptr;
-    waveformDataR = nullptr;
+    if (track <= 0 || track > (int)_tracks.size() || !_tracks[track - 1] || _tracks[track - 1]->offsetFrames.load() == frames) return;
+    _tracks[track - 1]->offsetFrames.store(frames);
+    updateTrackTiming();
+    buildTrackWaveforms();
+    _lastPlayedFrame.store(-9999);
+}
+
+int AudioHandler::getMixLengthInFrames() const
+{
+    if (!_fileLoaded.load() || _sampleRate == 0) return 0;
+    return (int)std::min<ma_uint64>(_mixPcmFrames.load() * _fpsNum / ((ma_uint64)_sampleRate * _fpsDen), 0x7FFFFFFE);
+}
+
+const float* AudioHandler::getTrackWaveform(int track, int side) const
+{
+    if (track == 0) return side == 0 ? getWaveformL() : getWaveformR();
+    size_t lane = (size_t)(track - 1) * 2 + (side == 0 ? 0 : 1);
+    if (track < 0 || waveformWidth <= 0 || (lane + 1) * waveformWidth > _trackWaveform.size()) return nullptr;
+    return &_trackWaveform[lane * waveformWidth];
+}
+
+void AudioHandler::updateTrackTiming()
+{
+    // Callers hold _mutex. Offsets are whole frames at this file's rate, so they move with fps.
+    ma_uint64 mixFrames = _totalPcmFrames;
     
-    _audioData.clear();
-    _initialized.store(false);
+    for (auto& track : _tracks) {
+        if (!track) continue;
+        ma_uint32 trackRate = track->handler->getSampleRate();
+        
+        // The ratio only changes when this file's rate does - on load, with the sound torn down
+        double ratio = (double)trackRate / std::max(1u, _sampleRate);
+        if (ratio != track->rateRatio) {
+            track->rateRatio = ratio;
+            track->scratch.resize(mixScratchFloats(ratio));
+        }
+        
+        ma_int64 frames = track->offsetFrames.load();
+        ma_int64 offset = frames * (ma_int64)trackRate * _fpsDen / (ma_int64)_fpsNum;
+        track->offsetSamples.store(offset);
+        
+        // Where the track ends, in this file's samples
+        ma_int64 end = (ma_int64)track->handler->_totalPcmFrames + offset;
+        if (end > 0) mixFrames = std::max(mixFrames, (ma_uint64)std::ceil(end / track->rateRatio));
+    }
+    _mixPcmFrames.store(mixFrames);
 }
 
-bool AudioHandler::loadFile(const char* fileName, float fps)
+void AudioHandler::buildTrackWaveforms()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    // Callers hold _mutex. Each track's own waveform, resampled onto this file's x axis.
+    _trackWaveform.clear();
+    if (waveformWidth <= 0 || _totalPcmFrames == 0) return;
     
-    // Set FPS first!
-    _fps = std::max(1.0f, fps);
+    _trackWaveform.assign(_tracks.size() * 2 * waveformWidth, 0.0f);
     
-    if (!_initialized.load() && !initEngine()) return false;
+    for (size_t t = 0; t < _tracks.size(); t++) {
+        if (!_tracks[t]) continue;
+        AudioHandler& track = *_tracks[t]->handler;
+        if (track.getWaveformWidth() != waveformWidth) track.generateWaveform(waveformWidth);
+        
+        const float* sides[2] = { track.getWaveformL(), track.getWaveformR() };
+        ma_uint64 trackFrames = track._totalPcmFrames;
+        if (!sides[0] || !sides[1] || trackFrames == 0) continue;
+        
+        for (int x = 0; x < waveformWidth; x++) {
+            double mainSample = (double)x * _totalPcmFrames / waveformWidth;
+            double trackSample = mainSample * _tracks[t]->rateRatio - _tracks[t]->offsetSamples.load();
+            if (trackSample < 0.0 || trackSample >= (double)trackFrames) continue;
+            
+            int trackX = std::min(waveformWidth - 1, (int)(trackSample * waveformWidth / trackFrames));
+            for (int side = 0; side < 2; side++) {
+                _trackWaveform[(t * 2 + side) * waveformWidth + x] = sides[side][trackX];
+            }
+        }
+    }
+}
+
+ma_uint64 AudioHandler::readMix(ma_uint64 frame, float* out, ma_uint64 frameCount)
+{
+    // Audio thread. Without tracks this is just the file, scaled by its gain.
+    float mainGain = _trackMute[0].load(std::memory_order_relaxed) ? 0.0f : _trackGain[0].load(std::memory_order_relaxed);
+    ma_uint64 count;
     
-    // Cleanup previous
-    if (_sound) {
-        ma_sound_stop(_sound);
-        ma_sound_uninit(_sound);
-        delete _sound;
-        _sound = nullptr;
+    if (_trackCount.load(std::memory_order_acquire) == 0) {
+        count = readMixed(frame, out, frameCount);
+    } else {
+        ma_uint64 mixFrames = _mixPcmFrames.load(std::memory_order_relaxed);
+        if (frame >= mixFrames) return 0;
+        count = std::min(frameCount, mixFrames - frame);
+        
+        // This file may end before the mix does
+        ma_uint64 mainRead = readMixed(frame, out, count);
+        std::fill(out + mainRead * 2, out + count * 2, 0.0f);
     }
     
-    if (_decoder) {
-        ma_decoder_uninit(_decoder);
-        delete _decoder;
-        _decoder = nullptr;
+    if (mainGain != 1.0f) {
+        for (ma_uint64 i = 0; i < count * 2; i++) out[i] *= mainGain;
     }
+    if (_trackCount.load(std::memory_order_acquire) == 0) return count;
     
-    _audioData.clear();
-    _fileLoaded.store(false);
-    _lastPlayedFrame.store(-9999);
+    // Never waits on the list - it is only held to swap a track in or out, and the
+    // tracks skip this one callback when that happens
+    std::unique_lock<std::mutex> tracksLock(_trackMutex, std::try_to_lock);
+    if (!tracksLock.owns_lock()) return count;
     
-    // Load sound
-    _sound = new ma_sound();
+    for (size_t t = 0; t < _tracks.size(); t++) {
+        float gain = _trackGain[t + 1].load(std::memory_order_relaxed);
+        MixTrack* track = _tracks[t].get();
+        if (!track || _trackMute[t + 1].load(std::memory_order_relaxed) || gain == 0.0f) continue;
+        
+        mixSource(*track->handler, track->rateRatio, (double)track->offsetSamples.load(std::memory_order_relaxed),
+                  gain, track->scratch.data(), frame, out, count);
+    }
+    return count;
+}
+
+void AudioHandler::mixSource(AudioHandler& source, double rateRatio, double offset, float gain, float* scratch,
+                             ma_uint64 frame, float* out, ma_uint64 frameCount)
+{
+    // Adds source's stereo mix into out. Frame f of this timeline is source frame
+    // f * rateRatio - offset; anything outside the source is silence.
+    const ma_int64 sourceFrames = (ma_int64)source._totalPcmFrames;
+    const bool sameRate = rateRatio == 1.0 && offset == std::floor(offset);
     
-    if (ma_sound_init_from_file(_engine, fileName, MA_SOUND_FLAG_NO_SPATIALIZATION | MA_SOUND_FLAG_DECODE, 
-                                 nullptr, nullptr, _sound) != MA_SUCCESS) {
-        std::cerr << "AudioHandler: Failed to load " << fileName << std::endl;
-        delete _sound;
-        _sound = nullptr;
+    for (ma_uint64 done = 0; done < frameCount; ) {
+        ma_uint64 n = std::min(MIX_CHUNK_FRAMES, frameCount - done);
+        float* dst = out + done * 2;
+        
+        if (sameRate) {
+            // Straight gain-and-add over the overlapping span
+            ma_int64 first = (ma_int64)(frame + done) - (ma_int64)offset;
+            ma_int64 skip = std::max<ma_int64>(0, -first);
+            ma_int64 avail = std::min<ma_int64>((ma_int64)n - skip, sourceFrames - (first + skip));
+            if (avail > 0) {
+                ma_uint64 got = source.readMixed((ma_uint64)(first + skip), scratch, (ma_uint64)avail);
+                float* d = dst + skip * 2;
+                for (ma_uint64 i = 0; i < got * 2; i++) d[i] += gain * scratch[i];
+            }
+        } else {
+            // Linear interpolation between the two nearest source samples
+            double start = (double)(frame + done) * rateRatio - offset;
+            ma_int64 first = (ma_int64)std::floor(start);
+            ma_int64 last = (ma_int64)std::floor(start + (n - 1) * rateRatio) + 1;
+            ma_int64 readFirst = std::max<ma_int64>(0, first);
+            ma_int64 readEnd = std::min(last + 1, sourceFrames);
+            
+            if (readEnd > readFirst) {
+                size_t span = (size_t)(last + 1 - first);
+                std::fill(scratch, scratch + span * 2, 0.0f);
+                source.readMixed((ma_uint64)readFirst, scratch + (readFirst - first) * 2, (ma_uint64)(readEnd - readFirst));
+                
+                for (ma_uint64 i = 0; i < n; i++) {
+                    double position = start + i * rateRatio - first;
+                    size_t index = (size_t)position;
+                    float frac = (float)(position - index);
+                    const float* s = scratch + index * 2;
+                    dst[i * 2] += gain * (s[0] + frac * (s[2] - s[0]));
+                    dst[i * 2 + 1] += gain * (s[1] + frac * (s[3] - s[1]));
+                }
+            }
+        }
+        done += n;
+    }
+}
+
+bool AudioHandler::loadSequence(const char* listFile, std::uint8_t* channelMap)
+{
+    std::ifstream in(listFile);
+    if (!in) {
+        std::cerr << "AudioHandler: Failed to load " << listFile << std::endl;
         return false;
     }
     
-    // Get info via decoder
-    _decoder = new ma_decoder();
-    ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 2, _sampleRate);
-    
-    if (ma_decoder_init_file(fileName, &cfg, _decoder) == MA_SUCCESS) {
-        _sampleRate = _decoder->outputSampleRate;
-        _channels = _decoder->outputChannels;
-        ma_decoder_get_length_in_pcm_frames(_decoder, &_totalPcmFrames);
-        
-        // Load for waveform
-        if (_totalPcmFrames > 0 && _totalPcmFrames < 30000000) {
-            _audioData.resize(_totalPcmFrames * _channels);
-            ma_uint64 framesRead;
-            ma_decoder_seek_to_pcm_frame(_decoder, 0);
-            ma_decoder_read_pcm_frames(_decoder, _audioData.data(), _totalPcmFrames, &framesRead);
+    fs::path listDir = fs::path(listFile).parent_path();
+    int nominalFps = (int)std::max(1L, std::lround((double)_fpsNum / _fpsDen));
+    std::vector<std::unique_ptr<SequenceSegment>> segments;
+    std::string line;
+    int lineNumber = 0;
+    
+    while (std::getline(in, line)) {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+        
+        // Quoted paths may contain spaces
+        std::istringstream fields(line.substr(first));
+        std::string path;
+        if (line[first] == '"') {
+            fields.get();
+            std::getline(fields, path, '"');
+        } else {
+            fields >> path;
         }
         
-        float duration = (float)_totalPcmFrames / _sampleRate;
-        // Calculate frames directly (getFileLengthInFrames checks _fileLoaded which isn't set yet)
-        int lengthInFrames = (int)(duration * _fps);
+        std::string times[3];
+        int count = 0;
+        while (count < 3 && fields >> times[count]) count++;
+        
+        std::unique_ptr<SequenceSegment> segment(new SequenceSegment());
+        bool valid = !path.empty() && count >= 2
+            && parseSequenceTime(times[0], nominalFps, segment->recordIn)
+            && parseSequenceTime(times[1], nominalFps, segment->recordOut)
+            && (count < 3 || parseSequenceTime(times[2], nominalFps, segment->sourceIn))
+            && segment->recordOut > segment->recordIn;
+        if (!valid) {
+            std::cerr << "AudioHandler: " << listFile << ":" << lineNumber
+                      << ": expected <file> <record in> <record out> [<source in>]" << std::endl;
+            continue;
+        }
         
-        std::cout << "AudioHandler: Loaded " << fileName << std::endl;
-        std::cout << "  " << _sampleRate << " Hz, " << _channels << " ch, " 
-                  << duration << "s (" << lengthInFrames << " frames @ " << _fps << " fps)" << std::endl;
+        fs::path file(path);
+        segment->path = (file.is_relative() ? listDir / file : file).string();
+        segments.push_back(std::move(segment));
     }
     
-    _currentFile = fileName;
-    _fileLoaded.store(true);
+    if (segments.empty()) {
+        std::cerr << "AudioHandler: No segments in " << listFile << std::endl;
+        return false;
+    }
+    
+    // Timeline order, starting at frame 0. Overlapping segments are mixed.
+    std::stable_sort(segments.begin(), segments.end(), [](const std::unique_ptr<SequenceSegment>& a, const std::unique_ptr<SequenceSegment>& b) {
+        return a->recordIn < b->recordIn;
+    });
+    int firstFrame = segments.front()->recordIn;
+    for (auto& segment : segments) {
+        segment->recordIn -= firstFrame;
+        segment->recordOut -= firstFrame;
+    }
+    
+    {
+        std::lock_guard<std::mutex> tracksLock(_trackMutex);
+        _segments.swap(segments);
+        _isSequence = true;
+    }
+    
+    // Stereo float at the first segment's rate - the only file opened up front
+    _sampleRate = 48000;
+    _channels = 2;
+    _sampleFormat = ma_format_f32;
+    _bytesPerFrame = 2 * sizeof(float);
+    channelMap[0] = MA_CHANNEL_FRONT_LEFT;
+    channelMap[1] = MA_CHANNEL_FRONT_RIGHT;
+    
+    if (openSegment(0)) {
+        _sampleRate = _segments[0]->handler->getSampleRate();
+    }
+    updateSequenceTiming();
+    
+    std::cout << "AudioHandler: Sequence " << listFile << " - " << _segments.size() << " segments, "
+              << _segments.back()->recordOut << " frames" << std::endl;
     return true;
 }
 
-void AudioHandler::releaseFile()
+void AudioHandler::updateSequenceTiming()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    // Callers hold _mutex; _trackMutex keeps the audio thread off half-updated segments
+    std::lock_guard<std::mutex> tracksLock(_trackMutex);
+    ma_uint64 totalFrames = 0;
     
-    if (_sound) {
-        ma_sound_stop(_sound);
-        ma_sound_uninit(_sound);
-        delete _sound;
-        _sound = nullptr;
+    for (auto& segment : _segments) {
+        segment->recordStart = samplesAtFrame(segment->recordIn, _sampleRate);
+        segment->recordEnd = samplesAtFrame(segment->recordOut, _sampleRate);
+        totalFrames = std::max(totalFrames, segment->recordEnd);
+        
+        if (segment->handler) {
+            ma_uint32 fileRate = segment->handler->getSampleRate();
+            segment->rateRatio = (double)fileRate / std::max(1u, _sampleRate);
+            segment->offset = segment->recordStart * segment->rateRatio - (double)samplesAtFrame(segment->sourceIn, fileRate);
+            // The first segment was opened before the timeline took its rate
+            segment->scratch.resize(mixScratchFloats(segment->rateRatio));
+        }
     }
-    
-    _fileLoaded.store(false);
-    _lastPlayedFrame.store(-9999);
+    _totalPcmFrames = totalFrames;
 }
 
-void AudioHandler::playAtFrame(int frame)
+bool AudioHandler::openSegment(size_t index)
 {
-    if (!_fileLoaded.load() || !_sound || !_engine) return;
-    
-    int lastFrame = _lastPlayedFrame.load();
+    SequenceSegment& segment = *_segments[index];
+    if (segment.handler) return true;
+    if (segment.failed) return false;
     
-    // Skip if same frame
-    if (frame == lastFrame) return;
-    
-    std::lock_guard<std::mutex> lock(_mutex);
-    
-    // Calculate PCM position for this frame
-    double secondsPerFrame = 1.0 / _fps;
-    double startSeconds = frame * secondsPerFrame;
-    ma_uint64 pcmStart = (ma_uint64)(startSeconds * _sampleRate);
-    
-    // How many PCM samples = 1 video frame
-    ma_uint64 samplesPerVideoFrame = (ma_uint64)(_sampleRate / _fps);
+    // Decode on demand - opening costs a header read, scrubbing decodes what it touches
+    std::unique_ptr<AudioHandler> handler(new AudioHandler(DEVICE_OFF));
+    handler->setLazyDecode(true);
+    if (!handler->loadFile(segment.path.c_str(), _fps)) {
+        segment.failed = true;
+        return false;
+    }
     
-    // Handle out of bounds
-    if (_totalPcmFrames > 0 && pcmStart >= _totalPcmFrames) {
-        ma_sound_stop(_sound);
-        _lastPlayedFrame.store(frame);
-        return;
+    ma_uint32 fileRate = handler->getSampleRate();
+    std::lock_guard<std::mutex> tracksLock(_trackMutex);
+    segment.rateRatio = (double)fileRate / std::max(1u, _sampleRate);
+    segment.offset = segment.recordStart * segment.rateRatio - (double)samplesAtFrame(segment.sourceIn, fileRate);
+    segment.scratch.resize(mixScratchFloats(segment.rateRatio));
+    segment.handler = std::move(handler);
+    return true;
+}
+
+void AudioHandler::prepareSegments(ma_uint64 firstFrame, ma_uint64 frameCount)
+{
+    // Callers hold _mutex. Open what this grain touches plus the segment after it,
+    // so crossing a cut doesn't wait on a file open.
+    ma_uint64 end = firstFrame + std::max<ma_uint64>(1, frameCount);
+    std::vector<size_t> wanted;
+    for (size_t i = 0; i < _segments.size(); i++) {
+        const SequenceSegment& segment = *_segments[i];
+        if (segment.recordEnd > firstFrame && segment.recordStart < end) {
+            wanted.push_back(i);
+        } else if (segment.recordStart >= end) {
+            wanted.push_back(i);
+            break;
+        }
     }
     
-    // Stop any current playback and clear stop time
-    ma_sound_stop(_sound);
-    ma_sound_set_stop_time_in_pcm_frames(_sound, (ma_uint64)-1);  // Clear previous stop time
+    for (size_t i : wanted) {
+        SequenceSegment& segment = *_segments[i];
+        if (!openSegment(i)) continue;
+        segment.lastUse = ++_segmentClock;
+        
+        // Decode the grain's blocks now rather than on the audio thread
+        ma_uint64 from = std::max(firstFrame, segment.recordStart);
+        ma_uint64 to = std::min(end, segment.recordEnd);
+        if (to > from) {
+            double position = std::max(0.0, from * segment.rateRatio - segment.offset);
+            segment.handler->prefetchBlocks((ma_uint64)position, (ma_uint64)((to - from) * segment.rateRatio) + 1);
+            if (segment.handler->waveformStale()) _peaksChanged.store(true);
+        }
+    }
     
-    // Seek to frame position
-    ma_sound_seek_to_pcm_frame(_sound, pcmStart);
+    // Close the least recently used beyond the budget
+    for (;;) {
+        size_t open = 0, oldest = _segments.size();
+        for (size_t i = 0; i < _segments.size(); i++) {
+            if (!_segments[i]->handler) continue;
+            open++;
+            if (oldest == _segments.size() || _segments[i]->lastUse < _segments[oldest]->lastUse) oldest = i;
+        }
+        if (open <= std::max(SEQUENCE_OPEN_SEGMENTS, wanted.size())) break;
+        
+        std::unique_ptr<AudioHandler> closed;
+        {
+            std::lock_guard<std::mutex> tracksLock(_trackMutex);
+            closed.swap(_segments[oldest]->handler);
+        }
+    }
+}
+
+void AudioHandler::readSequence(ma_uint64 frame, float* out, ma_uint64 frameCount)
+{
+    // Stereo; segments that aren't open yet are silent
+    std::fill(out, out + frameCount * 2, 0.0f);
+    ma_uint64 end = frame + frameCount;
     
-    // Get current engine time and set stop time (one video frame from now)
-    ma_uint64 engineTime = ma_engine_get_time_in_pcm_frames(_engine);
-    ma_sound_set_stop_time_in_pcm_frames(_sound, engineTime + samplesPerVideoFrame);
+    // Audio thread - while a segment is being swapped in or out, the whole sequence
+    // is silent for this callback rather than waiting on the list
+    std::unique_lock<std::mutex> tracksLock(_trackMutex, std::try_to_lock);
+    if (!tracksLock.owns_lock()) return;
     
-    // Start playback (will auto-stop after one frame duration)
-    ma_sound_start(_sound);
+    for (auto& segmentPtr : _segments) {
+        SequenceSegment& segment = *segmentPtr;
+        if (segment.recordStart >= end) break;
+        if (!segment.handler || segment.recordEnd <= frame) continue;
+        
+        ma_uint64 from = std::max(frame, segment.recordStart);
+        ma_uint64 to = std::min(end, segment.recordEnd);
+        mixSource(*segment.handler, segment.rateRatio, segment.offset, 1.0f, segment.scratch.data(),
+                  from, out + (from - frame) * 2, to - from);
+    }
+}
+
+void AudioHandler::sequenceWaveform(int pixelWidth)
+{
+    // Callers hold _mutex. Peaks of the blocks decoded so far in the open segments -
+    // like decode on demand, the rest fills in as the playhead visits it.
+    for (auto& segmentPtr : _segments) {
+        SequenceSegment& segment = *segmentPtr;
+        AudioHandler* source = segment.handler.get();
+        if (!source || _totalPcmFrames == 0) continue;
+        
+        std::lock_guard<std::mutex> blockLock(source->_blockMutex);
+        size_t blockCount = source->_blockPeaks.size() / std::max(1u, source->_channels);
+        ma_uint32 right = source->_channels >= 2 ? 1 : 0;
+        
+        int firstX = (int)(segment.recordStart * pixelWidth / _totalPcmFrames);
+        int endX = (int)std::min<ma_uint64>(pixelWidth, (segment.recordEnd * pixelWidth + _totalPcmFrames - 1) / _totalPcmFrames);
+        
+        for (int x = firstX; x < endX; x++) {
+            double from = std::max((double)segment.recordStart, (double)x * _totalPcmFrames / pixelWidth);
+            double to = std::min((double)segment.recordEnd, (double)(x + 1) * _totalPcmFrames / pixelWidth);
+            if (to <= from) continue;
+            
+            ma_int64 sourceFrom = (ma_int64)std::max(0.0, from * segment.rateRatio - segment.offset);
+            ma_int64 sourceTo = (ma_int64)std::max(0.0, to * segment.rateRatio - segment.offset);
+            for (size_t b = (size_t)(sourceFrom / PCM_BLOCK_FRAMES); b <= (size_t)(sourceTo / PCM_BLOCK_FRAMES) && b < blockCount; b++) {
+                _waveform[x] = std::max(_waveform[x], source->_blockPeaks[b * source->_channels]);
+                _waveform[(size_t)pixelWidth + x] = std::max(_waveform[(size_t)pixelWidth + x], source->_blockPeaks[b * source->_channels + right]);
+            }
+        }
+        source->_peaksChanged.store(false);
+    }
+}
+
+// ============================================================================
+// Follow mode
+// ============================================================================
+
+void AudioHandler::setFollowFile(const void* owner, bool enabled)
+{
+    std::lock_guard<std::mutex> ownerLock(_followOwnerMutex);
+    auto entry = std::find(_followOwners.begin(), _followOwners.end(), owner);
+    if (enabled && entry == _followOwners.end()) _followOwners.push_back(owner);
+    if (!enabled && entry != _followOwners.end()) _followOwners.erase(entry);
     
-    _lastPlayedFrame.store(frame);
+    enabled = !_followOwners.empty();
+    _followFile.store(enabled);
+    if (!enabled) {
+        stopFollowing();
+    } else if (_fileLoaded.load()) {
+        startFollowing();                       // no-op while one is running
+    }
 }
 
-void AudioHandler::stop()
+void AudioHandler::startFollowing()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    std::lock_guard<std::mutex> watchLock(_watchMutex);
+    if (_watch) return;
     
-    if (_sound) {
-        ma_sound_stop(_sound);
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Peaks only has no store to append to
+        if (!_fileLoaded.load() || _isSequence || _peaksOnly) return;
+        path = _currentFile;
     }
-    _lastPlayedFrame.store(-9999);
+    
+    _watch = new FileWatch();
+#ifdef __linux__
+    _watch->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
+    _watch->thread = std::thread(&AudioHandler::followLoop, this, _watch, path);
 }
 
-void AudioHandler::setFps(float fps)
+void AudioHandler::stopFollowing()
 {
-    _fps = std::max(1.0f, fps);
+    std::lock_guard<std::mutex> watchLock(_watchMutex);
+    if (!_watch) return;
+    
+    _watch->requestStop();
+    if (_watch->thread.joinable()) _watch->thread.join();
+#ifdef __linux__
+    if (_watch->wakeFd >= 0) close(_watch->wakeFd);
+#endif
+    delete _watch;
+    _watch = nullptr;
 }
 
-int AudioHandler::getFileLengthInFrames() const
+void AudioHandler::followLoop(FileWatch* watch, std::string path)
 {
-    if (!_fileLoaded.load() || _sampleRate == 0 || _fps <= 0) return 0;
-    double durationSeconds = (double)_totalPcmFrames / (double)_sampleRate;
-    return (int)(durationSeconds * _fps);
+    // Plain store: per-block peaks, so redraws don't rescan everything
+    auto prepare = [this]() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_fileLoaded.load()) return false;
+        if (!_lazy && !_compressed && !_isSequence && _blockPeaks.empty()) {
+            scanBlockPeaks(0);
+        }
+        return true;
+    };
+    if (!prepare()) return;
+    
+    int inotifyFd = -1;
+#ifdef __linux__
+    const uint32_t events = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    bool watching = inotifyFd >= 0 && inotify_add_watch(inotifyFd, path.c_str(), events) >= 0;
+    if (!watching) {
+        std::cerr << "AudioHandler: inotify unavailable for " << path << " - polling" << std::endl;
+    }
+#endif
+    
+    std::error_code ec;
+    std::uintmax_t knownSize = fs::file_size(path, ec);
+    fs::file_time_type knownTime = fs::last_write_time(path, ec);
+    std::cout << "AudioHandler: Following " << path << std::endl;
+    
+    // First pass catches anything written between the load and now
+    bool changed = true;
+    while (!watch->stop.load()) {
+        if (!changed) {
+#ifdef __linux__
+            if (watching) {
+                pollfd fds[2] = { { watch->wakeFd, POLLIN, 0 }, { inotifyFd, POLLIN, 0 } };
+                poll(fds, 2, FOLLOW_RESCAN_MS);
+                
+                // Drain the queue. A rename or delete drops the watch - put it back on the path.
+                alignas(inotify_event) char buffer[4096];
+                ssize_t bytes;
+                while ((bytes = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                    for (char* p = buffer; p < buffer + bytes; ) {
+                        const inotify_event* event = (const inotify_event*)p;
+                        if (event->mask & IN_IGNORED) watching = false;
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+                if (!watching) watching = inotify_add_watch(inotifyFd, path.c_str(), events) >= 0;
+            } else {
+                watch->sleep(FOLLOW_POLL_MS);
+                if (inotifyFd >= 0) watching = inotify_add_watch(inotifyFd, path.c_str(), events) >= 0;
+            }
+#else
+            watch->sleep(FOLLOW_POLL_MS);
+#endif
+            if (watch->stop.load()) break;
+            
+            std::uintmax_t size = fs::file_size(path, ec);
+            if (ec) continue;                   // mid-rename - look again later
+            fs::file_time_type time = fs::last_write_time(path, ec);
+            changed = size != knownSize || time != knownTime;
+            knownSize = size;
+            knownTime = time;
+            if (!changed) continue;
+        }
+        changed = false;
+        
+        FollowStatus status = appendTail(path);
+        if (status == FOLLOW_RELOAD) {
+            // Reloaded here rather than on the render thread - once the writer has
+            // stopped, so a file rewritten from scratch isn't loaded at every step
+            std::cout << "AudioHandler: " << path << " was rewritten - reloading" << std::endl;
+            _followStatus.store(FOLLOW_RELOAD);
+            bool settled = false;
+            while (!settled && !watch->stop.load()) {
+                watch->sleep(FOLLOW_SETTLE_MS);
+                std::uintmax_t size = fs::file_size(path, ec);
+                fs::file_time_type time = fs::last_write_time(path, ec);
+                settled = !ec && size == knownSize && time == knownTime;
+                knownSize = size;
+                knownTime = time;
+            }
+            if (watch->stop.load()) break;
+            
+            float fps;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                fps = _fps;
+            }
+            // A failed load leaves nothing loaded - the next validate tries again
+            if (!openFile(path.c_str(), fps) || !prepare()) break;
+            status = FOLLOW_GREW;
+        }
+        if (status == FOLLOW_GREW) {
+            _followStatus.store(FOLLOW_GREW);
+        }
+        
+        // A writer touches the file continuously - take its growth a few times a second at most
+        watch->sleep(FOLLOW_POLL_MS / 2);
+    }
+    
+#ifdef __linux__
+    if (inotifyFd >= 0) close(inotifyFd);
+#endif
 }
 
-void AudioHandler::generateWaveform(int pixelWidth)
+AudioHandler::FollowStatus AudioHandler::appendTail(const std::string& path)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    // Watcher thread. The tail is decoded without _mutex, so scrubbing carries on;
+    // only the watcher and loads (which stop it first) change the store's length.
+    TraceScope trace("appendTail");
     
-    delete[] waveformDataL;
-    delete[] waveformDataR;
-    waveformDataL = nullptr;
-    waveformDataR = nullptr;
-    waveformWidth = 0;
+    // What the store looked like when the file changed - checked again before appending
+    int sampleFormat;
+    ma_uint32 storeChannels, storeRate, bytesPerFrame;
+    ma_uint64 totalFrames;
+    bool lazy, fixedStore;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_fileLoaded.load() || _peaksOnly) return FOLLOW_UNCHANGED;
+        sampleFormat = _sampleFormat;
+        storeChannels = _channels;
+        storeRate = _sampleRate;
+        bytesPerFrame = _bytesPerFrame;
+        totalFrames = _totalPcmFrames;
+        lazy = _lazy;
+        fixedStore = _compressed || _mapped;
+    }
     
-    if (!_fileLoaded.load() || _audioData.empty() || pixelWidth <= 0) return;
+    ma_decoder* decoder = new ma_decoder();
+    ma_decoder_config cfg = decoderConfig(ma_format_unknown, 0, 0);
+    if (lazy) {
+        cfg.seekPointCount = 4096;
+    }
+    if (ma_decoder_init_file(path.c_str(), &cfg, decoder) != MA_SUCCESS) {
+        delete decoder;
+        return FOLLOW_UNCHANGED;                // header mid-write - next change retries
+    }
+    auto finish = [&decoder](FollowStatus status) {
+        ma_decoder_uninit(decoder);
+        delete decoder;
+        return status;
+    };
     
-    waveformWidth = pixelWidth;
-    waveformDataL = new float[pixelWidth]();
-    waveformDataR = new float[pixelWidth]();
+    ma_format format;
+    ma_uint32 channels, sampleRate;
+    if (ma_decoder_get_data_format(decoder, &format, &channels, &sampleRate, nullptr, 0) != MA_SUCCESS) {
+        return finish(FOLLOW_UNCHANGED);        // next change retries
+    }
+    if ((int)format != sampleFormat || channels != storeChannels || sampleRate != storeRate) {
+        return finish(FOLLOW_RELOAD);
+    }
     
-    size_t totalSamples = _audioData.size() / _channels;
-    size_t samplesPerPixel = std::max(size_t(1), totalSamples / pixelWidth);
+    ma_uint64 length = 0;
+    ma_decoder_get_length_in_pcm_frames(decoder, &length);
+    if (length != 0 && length < totalFrames) return finish(FOLLOW_RELOAD);
+    if (length == totalFrames) return finish(FOLLOW_UNCHANGED);     // writer hasn't updated the header
     
-    for (int x = 0; x < pixelWidth; x++) {
-        size_t start = x * samplesPerPixel;
-        size_t end = std::min(start + samplesPerPixel, totalSamples);
+    // Grew, but this store can't take a tail: blocks were compressed as a whole, or mapped from the disk cache
+    if (fixedStore) return finish(FOLLOW_RELOAD);
+    
+    if (lazy) {
+        // Nothing to decode - the new blocks come in as playback touches them
+        if (length == 0) return finish(FOLLOW_UNCHANGED);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_fileLoaded.load() || _totalPcmFrames != totalFrames) return finish(FOLLOW_UNCHANGED);
+        releaseSound();
         
-        float maxL = 0, maxR = 0;
+        ma_uint64 oldFrames = _totalPcmFrames;
+        {
+            std::lock_guard<std::mutex> decoderLock(_decoderMutex);
+            std::swap(_decoder, decoder);       // the old one is closed on the way out
+            _totalPcmFrames = length;
+        }
+        {
+            // The old last block was short - decode it again at full length
+            std::lock_guard<std::mutex> blockLock(_blockMutex);
+            size_t lastBlock = (size_t)(oldFrames / PCM_BLOCK_FRAMES);
+            size_t blockCount = (size_t)((length + PCM_BLOCK_FRAMES - 1) / PCM_BLOCK_FRAMES);
+            _blockPeaks.resize(blockCount * _channels, -1.0f);
+            if (oldFrames % PCM_BLOCK_FRAMES != 0) {
+                std::fill(_blockPeaks.begin() + lastBlock * _channels, _blockPeaks.begin() + (lastBlock + 1) * _channels, -1.0f);
+                _blockCache.erase(std::remove_if(_blockCache.begin(), _blockCache.end(),
+                    [lastBlock](const CachedBlock& entry) { return entry.block == lastBlock; }), _blockCache.end());
+            }
+        }
         
-        for (size_t i = start; i < end; i++) {
-            size_t idx = i * _channels;
-            maxL = std::max(maxL, std::abs(_audioData[idx]));
-            if (_channels >= 2)
-                maxR = std::max(maxR, std::abs(_audioData[idx + 1]));
+        if (_engine && !createSound()) {
+            std::cerr << "AudioHandler: Failed to create sound for " << path << std::endl;
+            _fileLoaded.store(false);
         }
+        fileStamp(path.c_str(), _fileSize, _fileTime, _fileHash);
+        std::vector<float> features = std::move(_features);
+        int featureFrames = _featureFrames;
+        timingChanged();
+        extendFeatures(std::move(features), featureFrames);
+        _peaksChanged.store(true);
+        return finish(FOLLOW_GREW);
+    }
+    
+    // Re-decode a little before the old end. If it doesn't match what we hold, this
+    // isn't the same recording any more. Codec output can shift at the old end, so
+    // only uncompressed sources are compared.
+    ma_uint64 checkFrames = isCompressedFormat(path.c_str()) ? 0 : std::min(FOLLOW_CHECK_FRAMES, totalFrames);
+    ma_uint64 from = totalFrames - checkFrames;
+    if (ma_decoder_seek_to_pcm_frame(decoder, from) != MA_SUCCESS) return finish(FOLLOW_RELOAD);
+    
+    std::vector<std::uint8_t> tail;
+    const ma_uint64 chunkFrames = 65536;
+    ma_uint64 framesRead = 0;
+    do {
+        size_t offset = tail.size();
+        tail.resize(offset + chunkFrames * bytesPerFrame);
+        ma_decoder_read_pcm_frames(decoder, tail.data() + offset, chunkFrames, &framesRead);
+        tail.resize(offset + framesRead * bytesPerFrame);
+    } while (framesRead == chunkFrames);
+    
+    // Compared under the lock - the store may only be read while it is held
+    size_t checkBytes = (size_t)(checkFrames * bytesPerFrame);
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_fileLoaded.load() || _peaksOnly || _totalPcmFrames != totalFrames) return finish(FOLLOW_UNCHANGED);
+    if (tail.size() < checkBytes || memcmp(tail.data(), _pcm + from * _bytesPerFrame, checkBytes) != 0) {
+        return finish(FOLLOW_RELOAD);
+    }
+    if (tail.size() == checkBytes) return finish(FOLLOW_UNCHANGED);
+    
+    // The audio thread reads the store without locking - only with the sound torn down can it move
+    releaseSound();
+    ma_uint64 oldFrames = _totalPcmFrames;
+    _audioData.insert(_audioData.end(), tail.begin() + checkBytes, tail.end());
+    _pcm = _audioData.data();
+    _totalPcmFrames = _audioData.size() / _bytesPerFrame;
+    _statDecodedBytes.fetch_add(tail.size() - checkBytes);
+    _statPcmBytes.store(pcmBytes());
+    
+    if (!_blockPeaks.empty()) {
+        scanBlockPeaks((size_t)(oldFrames / PCM_BLOCK_FRAMES));
+    }
+    fileStamp(path.c_str(), _fileSize, _fileTime, _fileHash);
+    if (_engine && !createSound()) {
+        std::cerr << "AudioHandler: Failed to create sound for " << path << std::endl;
+        _fileLoaded.store(false);
+    }
+    
+    // Features are binned per frame - only the new frames need binning
+    std::vector<float> features = std::move(_features);
+    int featureFrames = _featureFrames;
+    timingChanged();
+    extendFeatures(std::move(features), featureFrames);
+    return finish(FOLLOW_GREW);
+}
+
+void AudioHandler::scanBlockPeaks(size_t firstBlock)
+{
+    // Plain store, caller holds _mutex. Peaks per block and channel from firstBlock on.
+    size_t blockCount = (size_t)((_totalPcmFrames + PCM_BLOCK_FRAMES - 1) / PCM_BLOCK_FRAMES);
+    std::vector<float> samples((size_t)PCM_BLOCK_FRAMES * _channels);
+    
+    std::lock_guard<std::mutex> blockLock(_blockMutex);
+    _blockPeaks.resize(blockCount * _channels, 0.0f);
+    
+    for (size_t block = firstBlock; block < blockCount; block++) {
+        ma_uint64 first = (ma_uint64)block * PCM_BLOCK_FRAMES;
+        ma_uint64 frames = std::min<ma_uint64>(PCM_BLOCK_FRAMES, _totalPcmFrames - first);
+        readFloat(first, samples.data(), frames);
         
-        waveformDataL[x] = maxL;
-        waveformDataR[x] = (_channels >= 2) ? maxR : maxL;
+        float* peaks = &_blockPeaks[block * _channels];
+        for (ma_uint32 c = 0; c < _channels; c++) peaks[c] = 0.0f;
+        for (size_t i = 0; i < (size_t)frames * _channels; i++) {
+            float& peak = peaks[i % _channels];
+            peak = std::max(peak, std::abs(samples[i]));
+        }
     }
+    _peaksChanged.store(true);
 }
@@ -4,11 +4,18 @@
 #include "DDImage/Row.h"
 #include "DDImage/Knobs.h"
 #include "DDImage/Thread.h"
+#include "DDImage/Application.h"
 
 #include <Python.h>
 
 #include <iostream>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
 
 static AudioHandler audioHandler;
 
@@ -21,14 +28,103 @@ static const char* const HELP =
 
 using namespace DD::Image;
 
+// Render farm / nuke -t / nuke -x: no audio device, no scrubbing, no Python -
+// the node only draws its overlay. AUDIOPLAYER_NO_AUDIO=1 forces this in the GUI.
+static bool interactivePlayback()
+{
+    static const bool interactive = []() {
+        const char* env = std::getenv("AUDIOPLAYER_NO_AUDIO");
+        bool forcedOff = env && env[0] && std::strcmp(env, "0") != 0;
+        return Application::gui && !forcedOff;
+    }();
+    return interactive;
+}
+
+// Knob names/labels indexed by AudioHandler::Feature
+static const char* const featureKnobs[] = { "rms", "peak", "low", "mid", "high" };
+static const char* const featureLabels[] = { "RMS", "Peak", "Low band", "Mid band", "High band" };
+
+// Mixer tab - extra files heard with the main one, handler tracks 1..MIXER_TRACKS
+static const int MIXER_TRACKS = 4;
+static const char* const trackFileKnobs[] = { "track1_file", "track2_file", "track3_file", "track4_file" };
+static const char* const trackFileLabels[] = { "Track 1", "Track 2", "Track 3", "Track 4" };
+static const char* const trackOffsetKnobs[] = { "track1_offset", "track2_offset", "track3_offset", "track4_offset" };
+static const char* const trackGainKnobs[] = { "track1_gain", "track2_gain", "track3_gain", "track4_gain" };
+static const char* const trackMuteKnobs[] = { "track1_mute", "track2_mute", "track3_mute", "track4_mute" };
+
+// 0 = one waveform of the whole mix, 1 = one lane per track
+static const char* const trackDisplayNames[] = { "combined", "stacked", nullptr };
+
+// Stats tab - read-only, refreshed from AudioHandler::getStats()
+enum StatKnob {
+    STAT_LOAD_MS = 0, STAT_DECODED_MB, STAT_PCM_MB, STAT_WAVEFORM_KB, STAT_PLAY_CALLS,
+    STAT_SKIPPED, STAT_COALESCED, STAT_LOCK_WAITS, STAT_LOCK_WAIT_MS, STAT_UNDERRUNS,
+    STAT_PERIOD, STAT_CALLBACK_MS, STAT_CALLBACK_MAX_MS, STAT_JITTER_MS, STAT_JITTER_MAX_MS,
+    STAT_DEVICE_EVENTS, STAT_COUNT
+};
+static const char* const statKnobs[] = {
+    "stat_load_ms", "stat_decoded_mb", "stat_pcm_mb", "stat_waveform_kb", "stat_play_calls",
+    "stat_skipped", "stat_coalesced", "stat_lock_waits", "stat_lock_wait_ms", "stat_underruns",
+    "stat_period", "stat_callback_ms", "stat_callback_max_ms", "stat_jitter_ms", "stat_jitter_max_ms",
+    "stat_device_events"
+};
+static const char* const statLabels[] = {
+    "Load (ms)", "Decoded (MB)", "PCM in RAM (MB)", "Waveform (KB)", "Play calls",
+    "Skipped frames", "Coalesced frames", "Lock waits", "Lock wait (ms)", "Underruns",
+    "Period (frames)", "Callback (ms)", "Callback max (ms)", "Jitter (ms)", "Jitter max (ms)",
+    "Device events"
+};
+
+// 0 = auto-tune, n = fixed callback size of 64 << n frames
+static const char* const audioBufferNames[] = { "auto", "128", "256", "512", "1024", "2048", "4096", nullptr };
+
+// Units of the fine offset knob
+static const char* const fineOffsetUnitNames[] = { "ms", "samples", nullptr };
+
+// 0 = all channels, n = solo channel n
+static const char* const soloChannelNames[] = { "all", "1", "2", "3", "4", "5", "6", "7", "8", nullptr };
+
 class AudioPlayer : public Iop
 {
     const char* _fileKnob;
     bool _enabled;
     bool _showWaveform;
     int _offset;
+    double _fineOffset;
+    int _fineOffsetUnits;
+    const char* _syncReference;
+    int _syncReferenceStart;
+    const char* _plateTimecode;
+    int _plateStart;
+    bool _timecodeSync;
+    
+    // Mixer knobs; _trackIndex is each slot's handler track, -1 when empty
+    float _mainGain;
+    bool _mainMute;
+    const char* _trackFiles[MIXER_TRACKS];
+    int _trackOffsets[MIXER_TRACKS];
+    float _trackGains[MIXER_TRACKS];
+    bool _trackMutes[MIXER_TRACKS];
+    int _trackIndex[MIXER_TRACKS];
+    const void* _owner;             // the node - every Op of it shares its tracks and follow request
+    int _trackDisplay;
+    bool _tracksDirty;
+    std::vector<float> _mixWaveL;
+    std::vector<float> _mixWaveR;
     float _fps;
     float _waveformHeight;
+    int _soloChannel;
+    bool _compressPcm;
+    bool _lazyDecode;
+    bool _followFile;
+    int _audioBuffer;
+    
+    // Feature knobs - filled by "Bake to curves"
+    float _features[AudioHandler::FEATURE_COUNT];
+    
+    // Stats knobs - filled by "Refresh"
+    float _stats[STAT_COUNT];
+    const char* _callbackHistogram;
 
     Lock _lock;
     int _lastFrame;
@@ -43,12 +139,51 @@ public:
         _enabled = true;
         _showWaveform = true;
         _offset = 0;
+        _fineOffset = 0.0;
+        _fineOffsetUnits = 0;
+        _syncReference = "";
+        _syncReferenceStart = 0;
+        _plateTimecode = "";
+        _plateStart = 0;
+        _timecodeSync = false;
+        _mainGain = 1.0f;
+        _mainMute = false;
+        for (int i = 0; i < MIXER_TRACKS; i++) {
+            _trackFiles[i] = "";
+            _trackOffsets[i] = 0;
+            _trackGains[i] = 1.0f;
+            _trackMutes[i] = false;
+            _trackIndex[i] = -1;
+        }
+        _trackDisplay = 0;
+        _tracksDirty = true;
+        _owner = node ? (const void*)node : (const void*)this;
+        audioHandler.attachOwner(_owner);
         _fps = 25.0f;
         _waveformHeight = 1.0f;
+        _soloChannel = 0;
+        _compressPcm = false;
+        _lazyDecode = false;
+        _followFile = false;
+        // The platform's default size - 'auto' is opt-in
+        _audioBuffer = 1;
+        while ((64u << _audioBuffer) < AudioHandler::defaultPeriodFrames()) _audioBuffer++;
         _lastFrame = -9999;
+        for (int i = 0; i < AudioHandler::FEATURE_COUNT; i++) _features[i] = 0.0f;
+        for (int i = 0; i < STAT_COUNT; i++) _stats[i] = 0.0f;
+        _callbackHistogram = "";
+        
+        // Before anything can load a file - the engine starts with the first load
+        if (!interactivePlayback()) {
+            audioHandler.setDeviceMode(AudioHandler::DEVICE_OFF);
+        }
     }
 
-    ~AudioPlayer() override = default;
+    // The handler outlives the node - don't leave its tracks or watcher behind
+    ~AudioPlayer() override
+    {
+        audioHandler.detachOwner(_owner);
+    }
 
     const char* input_label(int input, char* buffer) const override
     {
@@ -58,7 +193,8 @@ public:
     void knobs(Knob_Callback f) override
     {
         File_knob(f, &_fileKnob, "file_name", "Audio file");
-        Tooltip(f, "Audio file (WAV, MP3, FLAC, OGG)");
+        Tooltip(f, "Audio file (WAV, MP3, FLAC, OGG, MOV/MP4 with PCM audio), or a .txt/.seq sequence list:\n"
+                   "one '<file> <record in> <record out> [<source in>]' per line");
 
         Bool_knob(f, &_enabled, "enabled", "Enable");
         SetFlags(f, Knob::STARTLINE);
@@ -67,10 +203,44 @@ public:
         Bool_knob(f, &_showWaveform, "show_waveform", "Waveform");
         Tooltip(f, "Show waveform overlay");
 
+        Enumeration_knob(f, &_soloChannel, soloChannelNames, "solo_channel", "Channel");
+        Tooltip(f, "Audible channel - 'all' downmixes every channel to stereo,\na number solos that channel of a multichannel file");
+
         Int_knob(f, &_offset, "offset", "Offset");
         SetFlags(f, Knob::STARTLINE);
         Tooltip(f, "Frame offset (+ delay, - advance)");
 
+        Float_knob(f, &_fineOffset, "fine_offset", "Fine offset");
+        SetRange(f, -40.0, 40.0);
+        Tooltip(f, "Sub-frame offset added to Offset (+ delay, - advance),\nfor sync finer than one frame");
+
+        Enumeration_knob(f, &_fineOffsetUnits, fineOffsetUnitNames, "fine_offset_units", "");
+        Tooltip(f, "Fine offset in milliseconds, or in samples at the file's rate");
+
+        File_knob(f, &_syncReference, "sync_reference", "Sync reference");
+        Tooltip(f, "Recording of the same take that is already in sync with the plate,\n"
+                   "e.g. camera scratch audio. Auto sync lines the audio file up with it.");
+
+        Int_knob(f, &_syncReferenceStart, "sync_reference_start", "starts at");
+        SetFlags(f, Knob::STARTLINE);
+        Tooltip(f, "Timeline frame where the sync reference begins");
+
+        Button(f, "auto_sync", "Auto sync");
+        Tooltip(f, "Find the delay between the sync reference and the audio file\n"
+                   "and set Offset and Fine offset from it");
+
+        String_knob(f, &_plateTimecode, "plate_timecode", "Plate timecode");
+        Tooltip(f, "Source timecode of the plate's first frame, HH:MM:SS:FF\n"
+                   "(';' before the frames for drop-frame), at the FPS below");
+
+        Int_knob(f, &_plateStart, "plate_start", "at frame");
+        Tooltip(f, "Timeline frame where the plate begins");
+
+        Bool_knob(f, &_timecodeSync, "timecode_sync", "Offset from timecode");
+        Tooltip(f, "Set Offset and Fine offset so the audio file's Broadcast WAV\n"
+                   "timecode (bext / iXML) lines up with the plate timecode.\n"
+                   "Follows the file, plate and FPS knobs while on.");
+
         Float_knob(f, &_fps, "fps", "FPS");
         SetFlags(f, Knob::STARTLINE);
         SetRange(f, 1.0, 120.0);
@@ -81,11 +251,93 @@ public:
         SetRange(f, 0.0, 2.0);
         Tooltip(f, "Waveform scale (1.0 = full height)");
 
+        Bool_knob(f, &_compressPcm, "compress_pcm", "Compress in memory");
+        SetFlags(f, Knob::STARTLINE);
+        Tooltip(f, "Keep decoded audio losslessly compressed in RAM (integer sources).\n"
+                   "About 1.4x less memory for 16-bit audio (1.2x for 24-bit, more when quiet),\n"
+                   "slightly more work per scrub.");
+
+        Bool_knob(f, &_lazyDecode, "decode_on_demand", "Decode on demand");
+        Tooltip(f, "Don't decode the whole file on load - decode only the parts you scrub.\n"
+                   "Opens long files instantly; the waveform fills in as you go.");
+
+        Bool_knob(f, &_followFile, "follow_file", "Follow growing file");
+        Tooltip(f, "For a file that is still being written, e.g. a bounce in progress.\n"
+                   "New audio is picked up as it lands - only the added part is decoded.");
+
+        Enumeration_knob(f, &_audioBuffer, audioBufferNames, "audio_buffer", "Audio buffer");
+        SetFlags(f, Knob::STARTLINE);
+        Tooltip(f, "Audio callback size in frames. 'auto' starts at the size saved for this machine,\n"
+                   "doubles it when playback keeps underrunning (see the Stats tab) and halves it\n"
+                   "again after 30 seconds without. Larger is steadier, smaller responds faster when scrubbing.");
+
         Divider(f, "");
         
         Text_knob(f, "", "AudioPlayer v2.5\nby Hendrik Proosa & Peter Mercell");
         SetFlags(f, Knob::DISABLED);
 
+        Tab_knob(f, "Mixer");
+
+        Float_knob(f, &_mainGain, "main_gain", "Audio file gain");
+        SetRange(f, 0.0, 2.0);
+        Tooltip(f, "Level of the main audio file in the mix");
+
+        Bool_knob(f, &_mainMute, "main_mute", "mute");
+
+        for (int i = 0; i < MIXER_TRACKS; i++) {
+            Divider(f, "");
+
+            File_knob(f, &_trackFiles[i], trackFileKnobs[i], trackFileLabels[i]);
+            Tooltip(f, "Another file heard together with the main one (dialogue, music, temp FX)");
+
+            Int_knob(f, &_trackOffsets[i], trackOffsetKnobs[i], "offset");
+            SetFlags(f, Knob::STARTLINE);
+            Tooltip(f, "Frames relative to the main audio file (+ delay, - advance)");
+
+            Float_knob(f, &_trackGains[i], trackGainKnobs[i], "gain");
+            SetRange(f, 0.0, 2.0);
+
+            Bool_knob(f, &_trackMutes[i], trackMuteKnobs[i], "mute");
+        }
+
+        Divider(f, "");
+
+        Enumeration_knob(f, &_trackDisplay, trackDisplayNames, "track_display", "Overlay");
+        Tooltip(f, "With mixer tracks: one waveform of the whole mix, or one lane per track");
+
+        Tab_knob(f, "Features");
+
+        Button(f, "bake_features", "Bake to curves");
+        Tooltip(f, "Write per-frame audio features as keyframes\n(reference e.g. AudioPlayer1.rms in expressions)");
+
+        for (int i = 0; i < AudioHandler::FEATURE_COUNT; i++) {
+            Float_knob(f, &_features[i], featureKnobs[i], featureLabels[i]);
+            SetFlags(f, Knob::STARTLINE | Knob::READ_ONLY);
+            SetRange(f, 0.0, 1.0);
+        }
+
+        Tab_knob(f, "Stats");
+
+        Button(f, "refresh_stats", "Refresh");
+        Tooltip(f, "Update the counters below\n(Python: node['refresh_stats'].execute(), then read node['stat_load_ms'] etc.)");
+
+        Button(f, "reset_stats", "Reset");
+        Tooltip(f, "Zero the playback counters - sizes and load time are kept");
+
+        Button(f, "write_trace", "Write trace");
+        Tooltip(f, "Write the Chrome trace recorded so far (start Nuke with\nAUDIOPLAYER_TRACE=/path/trace.json to record one)");
+
+        for (int i = 0; i < STAT_COUNT; i++) {
+            Float_knob(f, &_stats[i], statKnobs[i], statLabels[i]);
+            SetFlags(f, Knob::STARTLINE | Knob::READ_ONLY | Knob::DO_NOT_WRITE | Knob::NO_RERENDER | Knob::NO_UNDO);
+        }
+
+        Multiline_String_knob(f, &_callbackHistogram, "stat_callback_histogram", "Callback histogram", 10);
+        SetFlags(f, Knob::READ_ONLY | Knob::DO_NOT_WRITE | Knob::NO_RERENDER | Knob::NO_UNDO);
+        Tooltip(f, "Audio callbacks per bucket: time spent mixing, and how far the\n"
+                   "interval between callbacks strayed from the period. Callbacks\n"
+                   "near or past the period length mean the buffer is too small.");
+
         Iop::knobs(f);
     }
 
@@ -93,20 +345,296 @@ public:
     {
         if (k->is("file_name")) {
             audioHandler.setFileLoaded(false);
+            if (_timecodeSync) timecodeSync();
+            return 1;
+        }
+        if (k->is("solo_channel")) {
+            audioHandler.setSoloChannel(_soloChannel - 1);
             return 1;
         }
         if (k->is("enabled") && !_enabled) {
             audioHandler.stop();
             return 1;
         }
+        for (int i = 0; i < MIXER_TRACKS; i++) {
+            if (k->is(trackFileKnobs[i])) {
+                _tracksDirty = true;
+                return 1;
+            }
+            if (k->is(trackOffsetKnobs[i]) || k->is(trackGainKnobs[i]) || k->is(trackMuteKnobs[i])) {
+                applyMixer();
+                _lastFrame = -9999;
+                return 1;
+            }
+        }
+        if (k->is("main_gain") || k->is("main_mute")) {
+            applyMixer();
+            _lastFrame = -9999;
+            return 1;
+        }
+        if (k->is("auto_sync")) {
+            autoSync();
+            return 1;
+        }
+        if (k->is("timecode_sync") || k->is("plate_timecode") || k->is("plate_start")) {
+            if (_timecodeSync) timecodeSync();
+            return 1;
+        }
+        if (k->is("bake_features")) {
+            bakeFeatures();
+            return 1;
+        }
+        if (k->is("refresh_stats") || k->is("showPanel")) {
+            refreshStats();
+            return 1;
+        }
+        if (k->is("write_trace")) {
+            if (!traceFlush()) {
+                std::cerr << "AudioPlayer: Tracing is off - set AUDIOPLAYER_TRACE=/path/trace.json before starting Nuke" << std::endl;
+            }
+            return 1;
+        }
+        if (k->is("reset_stats")) {
+            audioHandler.resetStats();
+            refreshStats();
+            return 1;
+        }
+        if (k->is("decode_on_demand")) {
+            audioHandler.setLazyDecode(_lazyDecode);
+            audioHandler.setFileLoaded(false);
+            return 1;
+        }
+        if (k->is("follow_file")) {
+            audioHandler.setFollowFile(_owner, _followFile);
+            return 1;
+        }
+        if (k->is("compress_pcm")) {
+            audioHandler.setCompressPcm(_compressPcm);
+            audioHandler.setFileLoaded(false);
+            return 1;
+        }
+        if (k->is("audio_buffer")) {
+            applyAudioBuffer();
+            return 1;
+        }
         if (k->is("fps")) {
+            // Timing only - the decoded audio and waveform stay
             audioHandler.setFps(_fps);
-            audioHandler.setFileLoaded(false);
+            if (_timecodeSync) timecodeSync();
+            _lastFrame = -9999;
+            return 1;
+        }
+        if (k->is("offset")) {
+            _lastFrame = -9999;
+            return 1;
+        }
+        if (k->is("fine_offset") || k->is("fine_offset_units")) {
+            applyFineOffset();
+            _lastFrame = -9999;
             return 1;
         }
         return Iop::knob_changed(k);
     }
 
+    void bakeFeatures()
+    {
+        // Features are built on the first bake, not at load - make sure a file is in
+        if (!audioHandler.fileLoaded() && _fileKnob && _fileKnob[0]) {
+            audioHandler.loadFile(_fileKnob, _fps);
+        }
+        
+        // Kept until the file or fps changes, so a second bake costs nothing
+        if (audioHandler.fileLoaded() && audioHandler.getFeatureFrameCount() <= 0) {
+            audioHandler.computeFeatures();
+        }
+        
+        int frameCount = audioHandler.getFeatureFrameCount();
+        if (frameCount <= 0) {
+            std::cerr << "AudioPlayer: No audio features to bake" << std::endl;
+            return;
+        }
+        
+        for (int i = 0; i < AudioHandler::FEATURE_COUNT; i++) {
+            Knob* k = knob(featureKnobs[i]);
+            if (!k) continue;
+            
+            k->clear_animated(-1);
+            k->set_animated(0);
+            for (int frame = 0; frame < frameCount; frame++) {
+                // Key at timeline frame, so curves follow the offset knob
+                k->set_value_at(audioHandler.getFeature(i, frame), frame + _offset, 0);
+            }
+        }
+        
+        std::cout << "AudioPlayer: Baked " << frameCount << " frames of audio features" << std::endl;
+    }
+
+    void applyAudioBuffer()
+    {
+        if (_audioBuffer <= 0) {
+            audioHandler.setAutoTunePeriod(true);
+        } else {
+            audioHandler.setAutoTunePeriod(false);
+            audioHandler.setPeriodFrames(64u << _audioBuffer);
+        }
+    }
+
+    void autoSync()
+    {
+        if (!audioHandler.fileLoaded() && _fileKnob && _fileKnob[0]) {
+            audioHandler.loadFile(_fileKnob, _fps);
+        }
+        
+        double delay = 0.0;
+        float confidence = 0.0f;
+        if (!audioHandler.estimateSyncOffset(_syncReference, delay, confidence)) {
+            std::cerr << "AudioPlayer: Auto sync needs an audio file and a sync reference" << std::endl;
+            return;
+        }
+        if (confidence < 0.1f) {
+            std::cerr << "AudioPlayer: Weak sync match (" << confidence << ") - check the result by ear" << std::endl;
+        }
+        
+        setSyncOffset(_syncReferenceStart, delay);
+        std::cout << "AudioPlayer: Auto sync set offset " << _offset << " + " << _fineOffset
+                  << (_fineOffsetUnits == 1 ? " samples" : " ms") << std::endl;
+    }
+
+    void timecodeSync()
+    {
+        // Only the chunk headers are read - loading the file is left to _validate
+        AudioHandler::Timecode timecode;
+        if (!_fileKnob || !_fileKnob[0] || !AudioHandler::readTimecode(_fileKnob, timecode)) {
+            std::cerr << "AudioPlayer: No BWF timecode in " << (_fileKnob && _fileKnob[0] ? _fileKnob : "the audio file") << std::endl;
+            return;
+        }
+        
+        // The plate timecode is counted at the knob's rate
+        audioHandler.setFps(_fps);
+        double delay = 0.0;
+        if (!audioHandler.timecodeDelay(timecode, _plateTimecode, delay)) {
+            std::cerr << "AudioPlayer: Timecode sync needs the plate timecode as HH:MM:SS:FF" << std::endl;
+            return;
+        }
+        
+        setSyncOffset(_plateStart, delay);
+        std::cout << "AudioPlayer: Timecode sync set offset " << _offset << " + " << _fineOffset
+                  << (_fineOffsetUnits == 1 ? " samples" : " ms") << std::endl;
+    }
+
+    // Audio starts delaySeconds after startFrame
+    void setSyncOffset(int startFrame, double delaySeconds)
+    {
+        // Nearest whole frame, the remainder (under half a frame) goes to the fine offset
+        double fps = audioHandler.getFps();
+        double frames = delaySeconds * fps;
+        int wholeFrames = (int)std::lround(frames);
+        double fineSeconds = (frames - wholeFrames) / fps;
+        double fine = _fineOffsetUnits == 1 ? fineSeconds * audioHandler.getSampleRate() : fineSeconds * 1000.0;
+        
+        // Members too - the knobs store into them only at the next validate
+        _offset = startFrame + wholeFrames;
+        _fineOffset = fine;
+        if (Knob* k = knob("offset")) k->set_value(_offset);
+        if (Knob* k = knob("fine_offset")) k->set_value(_fineOffset);
+        applyFineOffset();
+        _lastFrame = -9999;
+    }
+
+    void loadTracks()
+    {
+        // The handler only decodes slots whose file changed
+        for (int i = 0; i < MIXER_TRACKS; i++) {
+            _trackIndex[i] = audioHandler.setTrack(_owner, i, _trackFiles[i]);
+        }
+        _tracksDirty = false;
+    }
+
+    void applyMixer()
+    {
+        audioHandler.setTrackGain(0, _mainGain);
+        audioHandler.setTrackMute(0, _mainMute);
+        for (int i = 0; i < MIXER_TRACKS; i++) {
+            if (_trackIndex[i] <= 0) continue;
+            audioHandler.setTrackGain(_trackIndex[i], _trackGains[i]);
+            audioHandler.setTrackMute(_trackIndex[i], _trackMutes[i]);
+            audioHandler.setTrackOffset(_trackIndex[i], _trackOffsets[i]);
+        }
+    }
+
+    // Level a handler track plays at - 0 when muted
+    float trackLevel(int track) const
+    {
+        if (track == 0) return _mainMute ? 0.0f : _mainGain;
+        for (int i = 0; i < MIXER_TRACKS; i++) {
+            if (_trackIndex[i] == track) return _trackMutes[i] ? 0.0f : _trackGains[i];
+        }
+        return 0.0f;
+    }
+
+    void applyFineOffset()
+    {
+        if (_fineOffsetUnits == 1) {
+            audioHandler.setSubFrameOffsetSamples((ma_int64)std::llround(_fineOffset));
+        } else {
+            audioHandler.setSubFrameOffsetMs(_fineOffset);
+        }
+    }
+
+    void refreshStats()
+    {
+        AudioHandler::Stats stats = audioHandler.getStats();
+        const double mb = 1024.0 * 1024.0;
+        
+        double values[STAT_COUNT];
+        values[STAT_LOAD_MS] = stats.loadMs;
+        values[STAT_DECODED_MB] = stats.decodedBytes / mb;
+        values[STAT_PCM_MB] = stats.pcmBytes / mb;
+        values[STAT_WAVEFORM_KB] = stats.waveformBytes / 1024.0;
+        values[STAT_PLAY_CALLS] = (double)stats.playCalls;
+        values[STAT_SKIPPED] = (double)stats.skippedFrames;
+        values[STAT_COALESCED] = (double)stats.coalescedFrames;
+        values[STAT_LOCK_WAITS] = (double)stats.lockWaits;
+        values[STAT_LOCK_WAIT_MS] = stats.lockWaitMs;
+        values[STAT_UNDERRUNS] = (double)stats.underruns;
+        
+        AudioHandler::CallbackStats callbacks = audioHandler.getCallbackStats();
+        values[STAT_PERIOD] = callbacks.periodFrames;
+        values[STAT_CALLBACK_MS] = callbacks.meanMs;
+        values[STAT_CALLBACK_MAX_MS] = callbacks.maxMs;
+        values[STAT_JITTER_MS] = callbacks.jitterMeanMs;
+        values[STAT_JITTER_MAX_MS] = callbacks.jitterMaxMs;
+        values[STAT_DEVICE_EVENTS] = (double)(callbacks.interruptions + callbacks.reroutes);
+        
+        for (int i = 0; i < STAT_COUNT; i++) {
+            if (Knob* k = knob(statKnobs[i])) k->set_value(values[i]);
+        }
+        
+        if (Knob* k = knob("stat_callback_histogram")) {
+            k->set_text(callbackHistogramText(callbacks).c_str());
+        }
+    }
+
+    static std::string callbackHistogramText(const AudioHandler::CallbackStats& callbacks)
+    {
+        std::string text = "   up to      mixing    interval jitter\n";
+        char line[96];
+        
+        for (int i = 0; i < AudioHandler::CALLBACK_HISTOGRAM_BUCKETS; i++) {
+            char edge[24];
+            if (i < AudioHandler::CALLBACK_HISTOGRAM_BUCKETS - 1) {
+                snprintf(edge, sizeof(edge), "%d us", AudioHandler::CALLBACK_HISTOGRAM_EDGES_US[i]);
+            } else {
+                snprintf(edge, sizeof(edge), "more");
+            }
+            snprintf(line, sizeof(line), "%9s  %10llu  %10llu\n", edge,
+                     (unsigned long long)callbacks.durationHistogram[i],
+                     (unsigned long long)callbacks.jitterHistogram[i]);
+            text += line;
+        }
+        return text;
+    }
+
     void append(Hash& hash) override
     {
         // Include frame in hash - makes node time-varying
@@ -115,6 +643,8 @@ public:
 
     void _validate(bool for_real) override
     {
+        TraceScope trace("_validate");
+        
         // Validate inputs
         for (int i = 0; i < maximum_inputs(); ++i) {
             if (input(i)) input(i)->validate(for_real);
@@ -127,19 +657,51 @@ public:
             
             int currentFrame = (int)outputContext().frame();
             
-            // Load file if needed
-            if (!audioHandler.fileLoaded() && _fileKnob && _fileKnob[0]) {
+            bool interactive = interactivePlayback();
+            
+            // Before a load, so the first frame table already has it
+            applyFineOffset();
+            
+            // A followed file grew, or was rewritten and reloaded by the watcher.
+            // Files on the farm are finished - nothing to follow.
+            audioHandler.setFollowFile(_owner, _followFile && interactive);
+            if (audioHandler.takeFollowStatus() == AudioHandler::FOLLOW_GREW && input0().format().width() > 0) {
+                audioHandler.generateWaveform(input0().format().width());
+            }
+            
+            // Load file if needed. On the farm only the overlay uses it - its peaks, or
+            // nothing at all with the waveform off.
+            if (!audioHandler.fileLoaded() && _fileKnob && _fileKnob[0] && (interactive || _showWaveform)) {
+                audioHandler.setCompressPcm(_compressPcm);
+                // Nobody scrubs on the farm - the overlay needs the whole waveform up front
+                audioHandler.setLazyDecode(_lazyDecode && interactive);
+                audioHandler.setPeaksOnly(!interactive);
                 if (audioHandler.loadFile(_fileKnob, _fps)) {
-                    if (input0().format().width() > 0) {
-                        audioHandler.generateWaveform(input0().format().width());
+                    // A reload of an unchanged file keeps its waveform
+                    int width = input0().format().width();
+                    if (width > 0 && audioHandler.getWaveformWidth() != width) {
+                        audioHandler.generateWaveform(width);
                     }
                 }
             }
             
+            // Tracks are positioned against the main file, so they come after it
+            if (_tracksDirty && audioHandler.fileLoaded()) {
+                loadTracks();
+            }
+            applyMixer();
+            
+            // Overlay only - nothing to play, and no Python from render threads
+            if (!interactive) return;
+            
+            // Knobs may have been restored from a script - keep the handler in step
+            audioHandler.setSoloChannel(_soloChannel - 1);
+            applyAudioBuffer();
+            
             // Play audio at current frame (only if frame changed)
             if (audioHandler.fileLoaded() && currentFrame != _lastFrame) {
                 int audioFrame = currentFrame - _offset;
-                int fileLen = audioHandler.getFileLengthInFrames();
+                int fileLen = audioHandler.getMixLengthInFrames();
                 
                 // Play if in valid range
                 if (audioFrame >= 0 && audioFrame < fileLen) {
@@ -148,6 +710,11 @@ public:
                 
                 _lastFrame = currentFrame;
                 
+                // Decode on demand fills the waveform in as blocks arrive
+                if (audioHandler.waveformStale() && input0().format().width() > 0) {
+                    audioHandler.generateWaveform(input0().format().width());
+                }
+                
                 // Clear caches so next frame will trigger _validate again
                 PyGILState_STATE gstate = PyGILState_Ensure();
                 PyRun_SimpleString("import nuke; nuke.clearRAMCache(); nuke.clearDiskCache()");
@@ -167,10 +734,32 @@ public:
             audioHandler.getWaveformWidth() != input0().format().width()) {
             audioHandler.generateWaveform(input0().format().width());
         }
+        
+        // Combined mixer overlay: every track at its level, summed per pixel
+        _mixWaveL.clear();
+        _mixWaveR.clear();
+        int tracks = audioHandler.getTrackCount();
+        int width = audioHandler.getWaveformWidth();
+        if (tracks > 1 && _trackDisplay == 0 && width > 0) {
+            _mixWaveL.assign(width, 0.0f);
+            _mixWaveR.assign(width, 0.0f);
+            for (int t = 0; t < tracks; t++) {
+                const float* waveL = audioHandler.getTrackWaveform(t, 0);
+                const float* waveR = audioHandler.getTrackWaveform(t, 1);
+                float level = trackLevel(t);
+                if (!waveL || !waveR || level <= 0.0f) continue;
+                for (int x = 0; x < width; x++) {
+                    _mixWaveL[x] = std::min(1.0f, _mixWaveL[x] + level * waveL[x]);
+                    _mixWaveR[x] = std::min(1.0f, _mixWaveR[x] + level * waveR[x]);
+                }
+            }
+        }
     }
 
     void engine(int y, int x, int r, ChannelMask channels, Row& row) override
     {
+        TraceScope trace("engine");
+        
         Row in(x, r);
         in.get(input0(), y, x, r, channels);
         if (aborted()) return;
@@ -179,9 +768,14 @@ public:
         if (audioHandler.fileLoaded() && _showWaveform) {
             int maxWidth = input0().format().width();
             int maxHeight = input0().format().height();
-            float* waveL = audioHandler.getWaveformL();
-            float* waveR = audioHandler.getWaveformR();
+            const float* waveL = audioHandler.getWaveformL();
+            const float* waveR = audioHandler.getWaveformR();
             int waveWidth = audioHandler.getWaveformWidth();
+            
+            if (!_mixWaveL.empty() && (int)_mixWaveL.size() == waveWidth) {
+                waveL = _mixWaveL.data();
+                waveR = _mixWaveR.data();
+            }
 
             int currentFrame = (int)outputContext().frame() - _offset;
             int fileLen = audioHandler.getFileLengthInFrames();
@@ -190,6 +784,34 @@ public:
             // Waveform center line (middle of image)
             int centerY = maxHeight / 2;
             float waveScale = _waveformHeight;
+            
+            // More than stereo: one lane per channel, stacked top to bottom.
+            // Stacked mixer tracks: one lane per track instead.
+            int numTracks = audioHandler.getTrackCount();
+            bool trackLanes = numTracks > 1 && _trackDisplay == 1;
+            int numChannels = trackLanes ? numTracks : audioHandler.getChannels();
+            bool lanes = (trackLanes || numChannels > 2) && maxHeight > 0;
+            const float* laneWave = nullptr;
+            float laneCenter = 0.0f;
+            float laneHalf = 0.0f;
+            bool laneHeard = true;
+            Channel laneChan = Chan_Red;
+            
+            if (lanes) {
+                float laneHeight = (float)maxHeight / numChannels;
+                int lane = (int)((maxHeight - 1 - y) / laneHeight);
+                if (lane < 0) lane = 0;
+                if (lane >= numChannels) lane = numChannels - 1;
+                
+                laneWave = trackLanes ? audioHandler.getTrackWaveform(lane, 0) : audioHandler.getWaveform(lane);
+                laneCenter = maxHeight - (lane + 0.5f) * laneHeight;
+                laneHalf = laneHeight * 0.5f;
+                laneChan = (lane % 2 == 0) ? Chan_Red : Chan_Green;
+                
+                // Dim channels and tracks that aren't audible
+                int solo = audioHandler.getSoloChannel();
+                laneHeard = trackLanes ? trackLevel(lane) > 0.0f : (solo < 0 || solo == lane);
+            }
 
             foreach(z, channels) {
                 float* CUR = row.writable(z) + x;
@@ -200,7 +822,20 @@ public:
                 while (CUR < END) {
                     float out = *inptr;
 
-                    if (waveL && waveR && waveWidth > 0) {
+                    if (lanes) {
+                        if (laneWave && waveWidth > 0 && z == laneChan) {
+                            int wavePos = (pos * waveWidth) / maxWidth;
+                            if (wavePos >= waveWidth) wavePos = waveWidth - 1;
+                            if (wavePos < 0) wavePos = 0;
+                            
+                            float amp = laneWave[wavePos];
+                            float laneAmpHeight = amp * waveScale * laneHalf;
+                            if (std::abs(y - laneCenter) <= laneAmpHeight) {
+                                float intensity = (0.4f + 0.6f * amp) * (laneHeard ? 1.0f : 0.35f);
+                                out = std::max(out, intensity);
+                            }
+                        }
+                    } else if (waveL && waveR && waveWidth > 0) {
                         // Map pixel position to waveform position
                         int wavePos = (pos * waveWidth) / maxWidth;
                         if (wavePos >= waveWidth) wavePos = waveWidth - 1;